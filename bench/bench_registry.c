@@ -0,0 +1,72 @@
+/**
+ * @file bench_registry.c
+ * @brief Microbenchmark for the client registry lookup path.
+ *
+ * Populates the registry with N synthetic clients and times find_client()
+ * over a shuffled mix of frame, title and client XIDs (plus some misses).
+ * Lookup cost should stay flat as N grows from 10 to 10,000.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "client.h"
+
+#define QUERIES 65536
+#define LOOKUPS 20000000L
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Frames and titles come from the WM's own XID range; client windows come
+ * from many other connections, each with its own resource base. */
+static xcb_window_t frame_xid(int i)  { return 0x00400000u + 2u * i; }
+static xcb_window_t title_xid(int i)  { return 0x00400001u + 2u * i; }
+static xcb_window_t client_xid(int i) { return 0x01000000u + ((uint32_t)(i % 97) << 21) + i; }
+
+static void bench(int n)
+{
+    for (int i = 0; i < n; i++) {
+        Client *c = client_alloc();
+        c->frame = frame_xid(i);
+        c->title = title_xid(i);
+        c->client = client_xid(i);
+        add_client(c);
+    }
+
+    static xcb_window_t queries[QUERIES];
+    srand(n);
+    for (int q = 0; q < QUERIES; q++) {
+        int i = rand() % n;
+        switch (rand() % 10) {
+            case 0: queries[q] = 0x03000000u + rand(); break; /* miss */
+            case 1: case 2: case 3: queries[q] = frame_xid(i); break;
+            case 4: case 5: case 6: queries[q] = title_xid(i); break;
+            default: queries[q] = client_xid(i); break;
+        }
+    }
+
+    unsigned long hits = 0;
+    double t0 = now_ns();
+    for (long k = 0; k < LOOKUPS; k++)
+        hits += find_client(queries[k & (QUERIES - 1)]) != NULL;
+    double t1 = now_ns();
+
+    printf("clients=%-6d lookups=%ld hits=%lu ns/lookup=%.2f\n",
+           n, LOOKUPS, hits, (t1 - t0) / LOOKUPS);
+
+    for (int i = 0; i < n; i++)
+        remove_client_by_frame(frame_xid(i));
+}
+
+int main(void)
+{
+    int sizes[] = { 10, 100, 1000, 10000 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        bench(sizes[s]);
+    return 0;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file bench_upload.c
+ * @brief Benchmark for uploading wallpaper-sized images to the X server.
+ *
+ * Times image_buffer_put() into a pixmap at 1080p, 4K and 8K, once through
+ * MIT-SHM and once through request-sized PutImage stripes. Each measurement
+ * ends with a round trip so it covers the server finishing the upload.
+ * Needs a running X server ($DISPLAY).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xcb/xcb.h>
+#include "image.h"
+
+#define RUNS 5
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void bench(xcb_connection_t *conn, xcb_screen_t *screen, const char *label,
+                  int width, int height, int use_shm)
+{
+    ImageBuffer buf;
+    if (!image_buffer_create(conn, &buf, width, height, use_shm)) {
+        printf("%-6s %-7s allocation failed\n", label, use_shm ? "shm" : "stripes");
+        return;
+    }
+    if (use_shm && buf.shmseg == XCB_NONE) {
+        printf("%-6s %-7s unavailable on this server\n", label, "shm");
+        image_buffer_destroy(conn, &buf);
+        return;
+    }
+    for (size_t i = 0; i < buf.size; i++)
+        buf.data[i] = (uint8_t)(i * 31);
+
+    xcb_pixmap_t pixmap = xcb_generate_id(conn);
+    xcb_create_pixmap(conn, screen->root_depth, pixmap, screen->root, width, height);
+    xcb_gcontext_t gc = xcb_generate_id(conn);
+    xcb_create_gc(conn, gc, pixmap, 0, NULL);
+
+    double best = 0, total = 0;
+    for (int r = 0; r < RUNS; r++) {
+        double t0 = now_ms();
+        image_buffer_put(conn, &buf, pixmap, gc, screen->root_depth, 0, 0);
+        free(xcb_get_input_focus_reply(conn, xcb_get_input_focus(conn), NULL));
+        double dt = now_ms() - t0;
+        total += dt;
+        if (r == 0 || dt < best)
+            best = dt;
+    }
+    printf("%-6s %-7s %5dx%-5d %7.1f MB  best=%8.2f ms  mean=%8.2f ms\n",
+           label, use_shm ? "shm" : "stripes", width, height,
+           buf.size / 1e6, best, total / RUNS);
+
+    xcb_free_gc(conn, gc);
+    xcb_free_pixmap(conn, pixmap);
+    image_buffer_destroy(conn, &buf);
+}
+
+int main(void)
+{
+    xcb_connection_t *conn = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(conn)) {
+        fprintf(stderr, "Error: Cannot open display\n");
+        return 1;
+    }
+    xcb_screen_t *screen = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
+
+    struct { const char *label; int w, h; } sizes[] = {
+        { "1080p", 1920, 1080 },
+        { "4K",    3840, 2160 },
+        { "8K",    7680, 4320 },
+    };
+    printf("max request length: %u bytes\n", xcb_get_maximum_request_length(conn) * 4);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        bench(conn, screen, sizes[s].label, sizes[s].w, sizes[s].h, 1);
+        bench(conn, screen, sizes[s].label, sizes[s].w, sizes[s].h, 0);
+    }
+
+    xcb_disconnect(conn);
+    return 0;
+}
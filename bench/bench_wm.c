@@ -0,0 +1,599 @@
+/**
+ * @file bench_wm.c
+ * @brief Load generator for a running etyWM.
+ *
+ * Drives the window manager on $DISPLAY through a fixed sequence of storms
+ * and reports what each one cost:
+ *
+ *   - map:       thousands of windows mapped in waves; latency from MapWindow
+ *                to the client being reparented into its frame.
+ *   - unmap:     the same windows unmapped; latency until the frame is hidden.
+ *   - configure: a flood of ConfigureRequests against one window.
+ *   - drag:      an XTEST pointer stream dragging a window by its title bar.
+ *   - resize:    an XTEST pointer stream pulling the bottom-right corner.
+ *   - click:     XTEST clicks inside the window that is already on top, which
+ *                should not make the WM send anything.
+ *   - workspace: switches back and forth between two workspaces of WAVE
+ *                windows each; latency from the _NET_CURRENT_DESKTOP request
+ *                until the WM announces the switch, compared to one frame.
+ *
+ * For every phase the WM's own counters (events handled, requests, round
+ * trips, flushes) are read from its stats socket before and after, so the
+ * results show server traffic as well as wall time. Results are printed and
+ * written as JSON to the file given with -o (default bench_wm.json).
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+#include <xcb/xtest.h>
+#include "config.h"
+
+#define WAVE 100
+#define TIMEOUT_MS 5000
+#define SWITCHES 50 /* Even */
+#define CLICKS 100
+#define FRAME_MS (1000.0 / 60)
+
+static xcb_connection_t *conn;
+static xcb_screen_t *screen;
+
+/* Totals read from the WM's stats socket */
+typedef struct {
+    double events, requests, round_trips, flushes;
+} WmTotals;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * @brief Returns the next event, waiting at most TIMEOUT_MS for it.
+ *
+ * @return The event (caller frees it), or NULL on timeout.
+ */
+static xcb_generic_event_t *next_event(void)
+{
+    double deadline = now_ms() + TIMEOUT_MS;
+    xcb_flush(conn);
+    for (;;) {
+        xcb_generic_event_t *ev = xcb_poll_for_event(conn);
+        if (ev)
+            return ev;
+        if (xcb_connection_has_error(conn))
+            return NULL;
+        int left = (int)(deadline - now_ms());
+        if (left <= 0)
+            return NULL;
+        struct pollfd pfd = { .fd = xcb_get_file_descriptor(conn), .events = POLLIN };
+        poll(&pfd, 1, left);
+    }
+}
+
+static xcb_window_t create_client(int x, int y, int w, int h)
+{
+    xcb_window_t win = xcb_generate_id(conn);
+    uint32_t values[] = { screen->white_pixel, XCB_EVENT_MASK_STRUCTURE_NOTIFY };
+    xcb_create_window(conn, XCB_COPY_FROM_PARENT, win, screen->root, x, y, w, h, 0,
+                      XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual,
+                      XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK, values);
+    return win;
+}
+
+static int find_window(const xcb_window_t *wins, int n, xcb_window_t win)
+{
+    for (int i = 0; i < n; i++)
+        if (wins[i] == win)
+            return i;
+    return -1;
+}
+
+/**
+ * @brief Waits until every window in 'wins' has been reparented into a frame.
+ *
+ * Records each window's frame and its latency relative to 't0', and selects
+ * StructureNotify on the frame so later phases can watch it.
+ *
+ * @return Number of windows framed before the timeout.
+ */
+static int wait_framed(const xcb_window_t *wins, xcb_window_t *frames, double *lat, int n, double t0)
+{
+    int done = 0;
+    while (done < n) {
+        xcb_generic_event_t *ev = next_event();
+        if (!ev)
+            break;
+        if ((ev->response_type & ~0x80) == XCB_REPARENT_NOTIFY) {
+            xcb_reparent_notify_event_t *rn = (xcb_reparent_notify_event_t *)ev;
+            int i = find_window(wins, n, rn->window);
+            if (i >= 0 && rn->event == rn->window && rn->parent != screen->root && !frames[i]) {
+                frames[i] = rn->parent;
+                lat[i] = now_ms() - t0;
+                uint32_t mask = XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+                xcb_change_window_attributes(conn, rn->parent, XCB_CW_EVENT_MASK, &mask);
+                done++;
+            }
+        }
+        free(ev);
+    }
+    return done;
+}
+
+/**
+ * @brief Waits until the WM has handled everything sent so far.
+ *
+ * The WM handles events in order, so once it frames a freshly mapped probe
+ * window it has also finished with every request before it.
+ *
+ * @return 1 on success, 0 on timeout.
+ */
+static int wm_barrier(void)
+{
+    xcb_window_t probe = create_client(0, 0, 10, 10), frame = XCB_NONE;
+    double lat;
+    xcb_map_window(conn, probe);
+    int ok = wait_framed(&probe, &frame, &lat, 1, now_ms()) == 1;
+    xcb_destroy_window(conn, probe);
+    return ok;
+}
+
+static double json_sum(const char *json, const char *key)
+{
+    double sum = 0;
+    size_t len = strlen(key);
+    for (const char *p = strstr(json, key); p; p = strstr(p + len, key))
+        sum += strtod(p + len, NULL);
+    return sum;
+}
+
+/**
+ * @brief Reads the WM's stats report from its socket.
+ *
+ * @return The JSON text (caller frees it), or NULL if the socket is missing.
+ */
+static char *read_wm_stats(void)
+{
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    const char *display = getenv("DISPLAY");
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (dir && *dir)
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/etywm-stats%s", dir, display ? display : "");
+    else
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/etywm-%u/etywm-stats%s",
+                 (unsigned)getuid(), display ? display : "");
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    size_t len = 0, cap = 65536;
+    char *buf = malloc(cap);
+    ssize_t n;
+    while (buf && (n = read(fd, buf + len, cap - len - 1)) > 0) {
+        len += n;
+        if (cap - len < 4096) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+    close(fd);
+    if (buf)
+        buf[len] = '\0';
+    return buf;
+}
+
+static WmTotals wm_totals(void)
+{
+    WmTotals t = { 0 };
+    char *json = read_wm_stats();
+    if (json) {
+        t.events = json_sum(json, "\"count\":");
+        t.requests = json_sum(json, "\"requests\":");
+        t.round_trips = json_sum(json, "\"round_trips\":");
+        t.flushes = json_sum(json, "\"flushes\":");
+        free(json);
+    }
+    return t;
+}
+
+static xcb_atom_t intern(const char *name)
+{
+    xcb_intern_atom_reply_t *r =
+        xcb_intern_atom_reply(conn, xcb_intern_atom(conn, 0, strlen(name), name), NULL);
+    xcb_atom_t atom = r ? r->atom : XCB_NONE;
+    free(r);
+    return atom;
+}
+
+/**
+ * @brief Asks the WM to switch workspaces and waits until it has.
+ *
+ * The WM updates _NET_CURRENT_DESKTOP after queuing every map and unmap of
+ * the switch, so once the PropertyNotify arrives the server has done them.
+ *
+ * @return Latency in ms, or -1 on timeout.
+ */
+static double switch_workspace(xcb_atom_t current_desktop, int n)
+{
+    xcb_client_message_event_t cm = {
+        .response_type = XCB_CLIENT_MESSAGE,
+        .format = 32,
+        .window = screen->root,
+        .type = current_desktop,
+        .data.data32 = { n, XCB_CURRENT_TIME },
+    };
+    double t0 = now_ms();
+    xcb_send_event(conn, 0, screen->root,
+                   XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY,
+                   (const char *)&cm);
+    for (;;) {
+        xcb_generic_event_t *ev = next_event();
+        if (!ev)
+            return -1;
+        int done = (ev->response_type & ~0x80) == XCB_PROPERTY_NOTIFY &&
+                   ((xcb_property_notify_event_t *)ev)->atom == current_desktop;
+        free(ev);
+        if (done)
+            return now_ms() - t0;
+    }
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Prints one phase's results and appends them to the JSON output.
+ *
+ * @param out JSON output file.
+ * @param name Phase name.
+ * @param ms Wall time of the phase.
+ * @param ops Operations the phase performed (windows, requests, motions).
+ * @param lat Per-operation latencies in ms, or NULL.
+ * @param before WM counters before the phase.
+ * @param after WM counters after the phase.
+ * @param extra Additional JSON members (without braces), or "".
+ */
+static void report_phase(FILE *out, const char *name, double ms, int ops, double *lat,
+                         const WmTotals *before, const WmTotals *after, const char *extra)
+{
+    static int first = 1;
+    double events = after->events - before->events;
+    double secs = ms > 0 ? ms / 1e3 : 1e-9;
+
+    printf("%-9s %6d ops %9.1f ms %10.0f ops/s %10.0f wm events/s %8.0f requests %6.0f round trips",
+           name, ops, ms, ops / secs, events / secs, after->requests - before->requests,
+           after->round_trips - before->round_trips);
+    fprintf(out, "%s\n    \"%s\": {\"ops\": %d, \"ms\": %.3f, \"ops_per_sec\": %.1f, "
+                 "\"wm_events\": %.0f, \"wm_events_per_sec\": %.1f, \"wm_requests\": %.0f, "
+                 "\"wm_round_trips\": %.0f, \"wm_flushes\": %.0f",
+            first ? "" : ",", name, ops, ms, ops / secs, events, events / secs,
+            after->requests - before->requests, after->round_trips - before->round_trips,
+            after->flushes - before->flushes);
+    first = 0;
+
+    if (lat && ops > 0) {
+        qsort(lat, ops, sizeof(double), cmp_double);
+        double p50 = lat[ops / 2], p99 = lat[(int)(ops * 0.99)], max = lat[ops - 1];
+        printf("  latency p50=%.2f p99=%.2f max=%.2f ms", p50, p99, max);
+        fprintf(out, ", \"latency_ms\": {\"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f}", p50, p99, max);
+    }
+    if (*extra)
+        fprintf(out, ", %s", extra);
+    fprintf(out, "}");
+    printf("\n");
+}
+
+static void fake_motion(int x, int y)
+{
+    xcb_test_fake_input(conn, XCB_MOTION_NOTIFY, 0, XCB_CURRENT_TIME, screen->root, x, y, 0);
+}
+
+static void fake_button(uint8_t type)
+{
+    xcb_test_fake_input(conn, type, 1, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+}
+
+/* Exits if there is no reply: the frame is gone, or the WM with it */
+static xcb_get_geometry_reply_t *frame_geometry(xcb_window_t frame)
+{
+    xcb_get_geometry_reply_t *g = xcb_get_geometry_reply(conn, xcb_get_geometry(conn, frame), NULL);
+    if (!g) {
+        fprintf(stderr, "Error: Could not read the geometry of frame 0x%x; did the WM exit?\n", frame);
+        exit(1);
+    }
+    return g;
+}
+
+/* Counts ConfigureNotify events for 'frame' already queued */
+static int drain_configures(xcb_window_t frame)
+{
+    int count = 0;
+    xcb_generic_event_t *ev;
+    while ((ev = xcb_poll_for_event(conn))) {
+        if ((ev->response_type & ~0x80) == XCB_CONFIGURE_NOTIFY &&
+            ((xcb_configure_notify_event_t *)ev)->window == frame)
+            count++;
+        free(ev);
+    }
+    return count;
+}
+
+/**
+ * @brief Presses at (x, y), moves the pointer 'motions' pixels diagonally
+ * one event at a time, releases, and waits for the WM to catch up.
+ *
+ * @return Wall time in ms, or -1 on timeout.
+ */
+static double pointer_stream(int x, int y, int motions)
+{
+    fake_motion(x, y);
+    fake_button(XCB_BUTTON_PRESS);
+    double t0 = now_ms();
+    for (int i = 1; i <= motions; i++) {
+        fake_motion(x + i / 4, y + i / 4);
+        if (i % 16 == 0)
+            xcb_flush(conn);
+    }
+    fake_button(XCB_BUTTON_RELEASE);
+    if (!wm_barrier())
+        return -1;
+    return now_ms() - t0;
+}
+
+int main(int argc, char **argv)
+{
+    int windows = 1000, configures = 20000, motions = 2000;
+    const char *out_path = "bench_wm.json";
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:m:o:")) != -1) {
+        switch (opt) {
+        case 'n': windows = atoi(optarg); break;
+        case 'c': configures = atoi(optarg); break;
+        case 'm': motions = atoi(optarg); break;
+        case 'o': out_path = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-n windows] [-c configures] [-m motions] [-o out.json]\n", argv[0]);
+            return 1;
+        }
+    }
+    windows = windows < WAVE ? WAVE : windows / WAVE * WAVE;
+
+    conn = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(conn)) {
+        fprintf(stderr, "Error: Cannot open display\n");
+        return 1;
+    }
+    screen = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
+    const xcb_query_extension_reply_t *xtest = xcb_get_extension_data(conn, &xcb_test_id);
+
+    FILE *out = fopen(out_path, "w");
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    fprintf(out, "{\n  \"windows\": %d, \"configures\": %d, \"motions\": %d,\n  \"phases\": {",
+            windows, configures, motions);
+
+    if (!wm_barrier()) {
+        fprintf(stderr, "Error: No window manager is framing windows on this display\n");
+        return 1;
+    }
+
+    xcb_window_t *wins = calloc(windows, sizeof(xcb_window_t));
+    xcb_window_t *frames = calloc(windows, sizeof(xcb_window_t));
+    double *lat = calloc(windows, sizeof(double));
+    if (!wins || !frames || !lat) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+
+    /* Map storm */
+    srand(1);
+    WmTotals before = wm_totals();
+    double t0 = now_ms();
+    for (int w = 0; w < windows; w += WAVE) {
+        for (int i = w; i < w + WAVE; i++) {
+            wins[i] = create_client(rand() % (screen->width_in_pixels / 2),
+                                    rand() % (screen->height_in_pixels / 2), 200 + rand() % 400,
+                                    150 + rand() % 300);
+            xcb_map_window(conn, wins[i]);
+        }
+        xcb_flush(conn);
+        if (wait_framed(wins + w, frames + w, lat + w, WAVE, now_ms()) != WAVE) {
+            fprintf(stderr, "Error: Timed out waiting for windows to be framed\n");
+            return 1;
+        }
+    }
+    double ms = now_ms() - t0;
+    WmTotals after = wm_totals();
+    report_phase(out, "map", ms, windows, lat, &before, &after, "");
+
+    /* Unmap storm: latency until the WM hides each frame */
+    before = after;
+    t0 = now_ms();
+    for (int w = 0; w < windows; w += WAVE) {
+        for (int i = w; i < w + WAVE; i++)
+            xcb_unmap_window(conn, wins[i]);
+        double wave_start = now_ms();
+        int done = 0;
+        while (done < WAVE) {
+            xcb_generic_event_t *ev = next_event();
+            if (!ev)
+                break;
+            if ((ev->response_type & ~0x80) == XCB_UNMAP_NOTIFY) {
+                xcb_unmap_notify_event_t *un = (xcb_unmap_notify_event_t *)ev;
+                int i = find_window(frames + w, WAVE, un->window);
+                if (i >= 0 && un->event == un->window) {
+                    lat[w + i] = now_ms() - wave_start;
+                    done++;
+                }
+            }
+            free(ev);
+        }
+        if (done != WAVE) {
+            fprintf(stderr, "Error: Timed out waiting for frames to be unmapped\n");
+            return 1;
+        }
+    }
+    ms = now_ms() - t0;
+    after = wm_totals();
+    report_phase(out, "unmap", ms, windows, lat, &before, &after, "");
+
+    for (int i = 0; i < windows; i++)
+        xcb_destroy_window(conn, wins[i]);
+    wm_barrier();
+
+    /* ConfigureRequest flood against one managed window */
+    xcb_window_t win = create_client(100, 100, 400, 300), frame = XCB_NONE;
+    xcb_map_window(conn, win);
+    wait_framed(&win, &frame, lat, 1, now_ms());
+    before = wm_totals();
+    t0 = now_ms();
+    for (int i = 0; i < configures; i++) {
+        uint32_t size[] = { 300 + i % 200, 200 + i % 150 };
+        xcb_configure_window(conn, win, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, size);
+    }
+    if (!wm_barrier()) {
+        fprintf(stderr, "Error: Timed out waiting for the ConfigureRequest flood\n");
+        return 1;
+    }
+    ms = now_ms() - t0;
+    after = wm_totals();
+    char extra[128];
+    snprintf(extra, sizeof(extra), "\"frame_updates\": %d", drain_configures(frame));
+    report_phase(out, "configure", ms, configures, NULL, &before, &after, extra);
+
+    /* XTEST pointer streams */
+    if (!xtest || !xtest->present) {
+        printf("XTEST not available; skipping drag and resize\n");
+    } else {
+        xcb_get_geometry_reply_t *g0 = frame_geometry(frame);
+        before = wm_totals();
+        ms = pointer_stream(g0->x + g0->width / 2, g0->y + TITLE_BAR_HEIGHT / 2, motions);
+        if (ms < 0) {
+            fprintf(stderr, "Error: Timed out waiting for the WM\n");
+            return 1;
+        }
+        after = wm_totals();
+        xcb_get_geometry_reply_t *g1 = frame_geometry(frame);
+        snprintf(extra, sizeof(extra), "\"frame_updates\": %d, \"moved\": %s",
+                 drain_configures(frame), (g1->x != g0->x || g1->y != g0->y) ? "true" : "false");
+        report_phase(out, "drag", ms, motions, NULL, &before, &after, extra);
+        free(g0);
+
+        /* Wait out the double-click window before the next press */
+        usleep(400 * 1000);
+        before = wm_totals();
+        /* Inside the bottom-right resize handle but clear of the rounded corner */
+        ms = pointer_stream(g1->x + g1->width - 4, g1->y + g1->height - 4, motions);
+        if (ms < 0) {
+            fprintf(stderr, "Error: Timed out waiting for the WM\n");
+            return 1;
+        }
+        after = wm_totals();
+        xcb_get_geometry_reply_t *g2 = frame_geometry(frame);
+        snprintf(extra, sizeof(extra), "\"frame_updates\": %d, \"resized\": %s",
+                 drain_configures(frame),
+                 (g2->width != g1->width || g2->height != g1->height) ? "true" : "false");
+        report_phase(out, "resize", ms, motions, NULL, &before, &after, extra);
+        free(g1);
+
+        /* The press raised the window; clicking it again needs no restack.
+         * A barrier of its own first gives the requests every barrier costs. */
+        WmTotals idle = wm_totals();
+        if (!wm_barrier()) {
+            fprintf(stderr, "Error: Timed out waiting for the WM\n");
+            return 1;
+        }
+        before = wm_totals();
+        double barrier_requests = before.requests - idle.requests;
+        fake_motion(g2->x + g2->width / 2, g2->y + g2->height / 2);
+        t0 = now_ms();
+        for (int i = 0; i < CLICKS; i++) {
+            fake_button(XCB_BUTTON_PRESS);
+            fake_button(XCB_BUTTON_RELEASE);
+        }
+        if (!wm_barrier()) {
+            fprintf(stderr, "Error: Timed out waiting for the WM\n");
+            return 1;
+        }
+        ms = now_ms() - t0;
+        after = wm_totals();
+        snprintf(extra, sizeof(extra), "\"barrier_requests\": %.0f, \"requests_per_click\": %.3f",
+                 barrier_requests, (after.requests - before.requests - barrier_requests) / CLICKS);
+        report_phase(out, "click", ms, CLICKS, NULL, &before, &after, extra);
+        free(g2);
+    }
+    xcb_destroy_window(conn, win);
+    wm_barrier();
+
+    /* Workspace switching: WAVE windows on each of workspaces 0 and 1 */
+    xcb_atom_t current_desktop = intern("_NET_CURRENT_DESKTOP");
+    uint32_t root_mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+    xcb_change_window_attributes(conn, screen->root, XCB_CW_EVENT_MASK, &root_mask);
+    xcb_window_t ws_wins[2 * WAVE], ws_frames[2 * WAVE] = { 0 };
+    double ws_lat[2 * WAVE];
+    for (int w = 1; w >= 0; w--) {
+        if (switch_workspace(current_desktop, w) < 0) {
+            fprintf(stderr, "Error: The WM does not answer _NET_CURRENT_DESKTOP\n");
+            return 1;
+        }
+        for (int i = w * WAVE; i < (w + 1) * WAVE; i++) {
+            ws_wins[i] = create_client(rand() % (screen->width_in_pixels / 2),
+                                       rand() % (screen->height_in_pixels / 2), 200 + rand() % 400,
+                                       150 + rand() % 300);
+            xcb_map_window(conn, ws_wins[i]);
+        }
+        if (wait_framed(ws_wins + w * WAVE, ws_frames + w * WAVE, ws_lat, WAVE, now_ms()) != WAVE) {
+            fprintf(stderr, "Error: Timed out waiting for windows to be framed\n");
+            return 1;
+        }
+    }
+    before = wm_totals();
+    t0 = now_ms();
+    int over = 0;
+    for (int i = 0; i < SWITCHES; i++) {
+        ws_lat[i] = switch_workspace(current_desktop, (i + 1) % 2);
+        if (ws_lat[i] < 0) {
+            fprintf(stderr, "Error: Timed out waiting for a workspace switch\n");
+            return 1;
+        }
+        over += ws_lat[i] > FRAME_MS;
+    }
+    ms = now_ms() - t0;
+    after = wm_totals();
+    snprintf(extra, sizeof(extra), "\"windows_per_workspace\": %d, \"frame_ms\": %.3f, \"over_frame\": %d",
+             WAVE, FRAME_MS, over);
+    report_phase(out, "workspace", ms, SWITCHES, ws_lat, &before, &after, extra);
+    /* An even number of switches ends back on workspace 0 */
+    for (int i = 0; i < 2 * WAVE; i++)
+        xcb_destroy_window(conn, ws_wins[i]);
+    wm_barrier();
+
+    /* The WM's complete counters go along for per-handler detail */
+    char *wm_stats = read_wm_stats();
+    fprintf(out, "\n  },\n  \"wm_stats\": %s\n}\n", wm_stats ? wm_stats : "null\n");
+    free(wm_stats);
+    fclose(out);
+    printf("Results written to %s\n", out_path);
+
+    free(wins);
+    free(frames);
+    free(lat);
+    xcb_disconnect(conn);
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "atoms.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+#include "log.h"
+
+xcb_atom_t atoms[ATOM_COUNT];
+
+#define ATOM_NAME(name, str) str,
+static const char *const atom_names[ATOM_COUNT] = {
+    ATOM_LIST(ATOM_NAME)
+};
+#undef ATOM_NAME
+
+int atoms_init(xcb_connection_t *conn)
+{
+    xcb_intern_atom_cookie_t cookies[ATOM_COUNT];
+    int ok = 1;
+
+    for (int i = 0; i < ATOM_COUNT; i++)
+        cookies[i] = xcb_intern_atom(conn, 0, strlen(atom_names[i]), atom_names[i]);
+
+    /* The first wait covers the whole batch; later replies are already in */
+    stats_round_trip();
+    for (int i = 0; i < ATOM_COUNT; i++)
+    {
+        xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(conn, cookies[i], NULL);
+        if (reply)
+        {
+            atoms[i] = reply->atom;
+            free(reply);
+        }
+        else
+        {
+            atoms[i] = XCB_ATOM_NONE;
+            log_warn("Failed to intern atom %s", atom_names[i]);
+            ok = 0;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,49 @@
+#ifndef ATOMS_H
+#define ATOMS_H
+
+#include <xcb/xcb.h>
+
+/* Every atom etyWM uses, interned once at startup by atoms_init().
+ * To add one, append a line here and refer to it as atoms[ATOM_<name>].
+ */
+#define ATOM_LIST(X)                                        \
+    X(WM_PROTOCOLS,                 "WM_PROTOCOLS")         \
+    X(WM_DELETE_WINDOW,             "WM_DELETE_WINDOW")     \
+    X(WM_TAKE_FOCUS,                "WM_TAKE_FOCUS")        \
+    X(WM_STATE,                     "WM_STATE")             \
+    X(UTF8_STRING,                  "UTF8_STRING")          \
+    X(NET_SUPPORTED,                "_NET_SUPPORTED")       \
+    X(NET_SUPPORTING_WM_CHECK,      "_NET_SUPPORTING_WM_CHECK") \
+    X(NET_CLIENT_LIST,              "_NET_CLIENT_LIST")     \
+    X(NET_ACTIVE_WINDOW,            "_NET_ACTIVE_WINDOW")   \
+    X(NET_NUMBER_OF_DESKTOPS,       "_NET_NUMBER_OF_DESKTOPS") \
+    X(NET_CURRENT_DESKTOP,          "_NET_CURRENT_DESKTOP") \
+    X(NET_WM_DESKTOP,               "_NET_WM_DESKTOP")      \
+    X(NET_WM_NAME,                  "_NET_WM_NAME")         \
+    X(NET_WM_STATE,                 "_NET_WM_STATE")        \
+    X(NET_WM_STATE_FULLSCREEN,      "_NET_WM_STATE_FULLSCREEN") \
+    X(NET_WM_STATE_ABOVE,           "_NET_WM_STATE_ABOVE")  \
+    X(NET_WM_WINDOW_TYPE,           "_NET_WM_WINDOW_TYPE")  \
+    X(NET_WM_WINDOW_OPACITY,        "_NET_WM_WINDOW_OPACITY") \
+    X(NET_WM_SYNC_REQUEST,          "_NET_WM_SYNC_REQUEST") \
+    X(NET_WM_SYNC_REQUEST_COUNTER,  "_NET_WM_SYNC_REQUEST_COUNTER") \
+    X(NET_WM_CM_S0,                 "_NET_WM_CM_S0")        \
+    X(XROOTPMAP_ID,                 "_XROOTPMAP_ID")        \
+    X(ESETROOT_PMAP_ID,             "ESETROOT_PMAP_ID")
+
+#define ATOM_ENUM(name, str) ATOM_##name,
+enum {
+    ATOM_LIST(ATOM_ENUM)
+    ATOM_COUNT
+};
+#undef ATOM_ENUM
+
+extern xcb_atom_t atoms[ATOM_COUNT];
+
+/* Interns the whole table: all requests are sent before the first reply is
+ * read, so startup pays a single round trip. Atoms that fail to intern are
+ * left as XCB_ATOM_NONE. Returns 0 if any failed.
+ */
+int atoms_init(xcb_connection_t *conn);
+
+#endif // ATOMS_H
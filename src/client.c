@@ -1,103 +1,159 @@
 #include "client.h"
+#include "atoms.h"
 #include "config.h"
 #include "draw.h"
+#include "layout.h"
+#include "outputs.h"
+#include "resize_sync.h"
+#include "resources.h"
+#include "spatial.h"
+#include "stack.h"
+#include "stats.h"
+#include "title.h"
+#include "workspace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
-#include <xcb/render.h>
+#include "log.h"
 #include <xcb/shape.h>
 
-#define XCB_RENDER_PICT_FORMAT_ARGB32 0x34325241
-#define XCB_RENDER_CP_ALPHA 0x00000001
-
+/* Recently created, not yet managed top-level windows.  Clients normally map
+ * shortly after creating their window, so a small ring is enough; a miss
+ * just costs create_frame() one get_geometry round trip. */
+#define TOPLEVEL_CACHE_SIZE 64
 
+typedef struct
+{
+    xcb_window_t win;
+    int x, y, width, height;
+} ToplevelGeometry;
 
-static Client *clients = NULL;
+static ToplevelGeometry toplevels[TOPLEVEL_CACHE_SIZE];
+static int toplevel_next = 0;
 
-void add_client(Client *c)
+/* Unmapped frames (with their title bar and resize handles) kept for
+ * reuse, so short-lived windows (tooltips, dialogs, toasts) do not pay for
+ * creating and destroying them */
+typedef struct
 {
-    if (!c)
-    {
-        fprintf(stderr, "Warning: Tried to add a NULL client\n");
+    xcb_window_t frame;
+    xcb_window_t title;
+    xcb_window_t handles[RESIZE_HANDLES];
+} FramePair;
+
+/* Resize handles.  The server does the hit testing: a press on a handle
+ * reaches the frame with the handle as its child, which names the edges
+ * without asking the server anything.  Edge handles are longer than any
+ * frame and get clipped by it, and every handle has the win_gravity of its
+ * edge or corner, so resizing the frame moves them along in the same
+ * request.  Corners come last to stack above the edges they overlap; the
+ * client stacks above them all, and the edges lie in the RESIZE_BORDER
+ * around it.
+ * Glyphs are from the standard cursor font. */
+#define HANDLE_SPAN 32767
+
+static const struct
+{
+    int edges;
+    uint8_t gravity;
+    uint16_t glyph;
+} handle_specs[RESIZE_HANDLES] = {
+    {RESIZE_TOP, XCB_GRAVITY_NORTH_WEST, 138},                   /* XC_top_side */
+    {RESIZE_LEFT, XCB_GRAVITY_NORTH_WEST, 70},                   /* XC_left_side */
+    {RESIZE_RIGHT, XCB_GRAVITY_NORTH_EAST, 96},                  /* XC_right_side */
+    {RESIZE_BOTTOM, XCB_GRAVITY_SOUTH_WEST, 16},                 /* XC_bottom_side */
+    {RESIZE_TOP | RESIZE_LEFT, XCB_GRAVITY_NORTH_WEST, 134},     /* XC_top_left_corner */
+    {RESIZE_TOP | RESIZE_RIGHT, XCB_GRAVITY_NORTH_EAST, 136},    /* XC_top_right_corner */
+    {RESIZE_BOTTOM | RESIZE_LEFT, XCB_GRAVITY_SOUTH_WEST, 12},   /* XC_bottom_left_corner */
+    {RESIZE_BOTTOM | RESIZE_RIGHT, XCB_GRAVITY_SOUTH_EAST, 14},  /* XC_bottom_right_corner */
+};
+
+static xcb_cursor_t handle_cursors[RESIZE_HANDLES];
+
+static FramePair frame_pool[FRAME_POOL_SIZE];
+static int frame_pool_len = 0;
+static int frame_pool_high = 0;
+static unsigned long frames_created = 0;
+static unsigned long frames_reused = 0;
+static unsigned long frames_destroyed = 0;
+
+/* Set while adopt_existing_windows() frames a window that is already placed */
+static int adopting = 0;
+
+void note_toplevel_geometry(xcb_window_t win, int x, int y, int width, int height)
+{
+    if (frame_pool_contains(win))
         return;
-    }
-    c->next = clients;
-    clients = c;
-    fprintf(stderr, "Info: Added client (frame 0x%x)\n", c->frame);
-}
 
-void remove_client_by_frame(xcb_window_t frame)
-{
-    Client **curr = &clients;
-    while (*curr)
+    ToplevelGeometry *t = NULL;
+    for (int i = 0; i < TOPLEVEL_CACHE_SIZE; i++)
     {
-        if ((*curr)->frame == frame)
+        if (toplevels[i].win == win)
         {
-            Client *tmp = *curr;
-            *curr = (*curr)->next;
-            fprintf(stderr, "Info: Removing client (frame 0x%x)\n", frame);
-            free(tmp);
-            return;
+            t = &toplevels[i];
+            break;
         }
-        curr = &((*curr)->next);
     }
-    fprintf(stderr, "Warning: No client found with frame 0x%x to remove\n", frame);
+    if (!t)
+    {
+        t = &toplevels[toplevel_next];
+        toplevel_next = (toplevel_next + 1) % TOPLEVEL_CACHE_SIZE;
+    }
+    t->win = win;
+    t->x = x;
+    t->y = y;
+    t->width = width;
+    t->height = height;
 }
 
-Client *find_client(xcb_window_t win)
+void forget_toplevel_geometry(xcb_window_t win)
 {
-    Client *c = clients;
-    while (c)
+    for (int i = 0; i < TOPLEVEL_CACHE_SIZE; i++)
     {
-        if (c->frame == win || c->title == win || c->client == win)
-            return c;
-        c = c->next;
+        if (toplevels[i].win == win)
+            toplevels[i].win = XCB_NONE;
     }
-    return NULL;
 }
 
-void apply_alpha_blending(xcb_connection_t *conn, xcb_window_t window, uint8_t alpha_value)
+/* Looks up and consumes the cached geometry of 'win' */
+static int take_toplevel_geometry(xcb_window_t win, ToplevelGeometry *out)
 {
-    xcb_render_picture_t picture = xcb_generate_id(conn);
-    xcb_render_create_picture(conn, picture, window, XCB_RENDER_PICT_FORMAT_ARGB32, 0, NULL);
-
-    uint32_t values[1] = {alpha_value};
-    xcb_render_change_picture(conn, picture, XCB_RENDER_CP_ALPHA, values);
-
-    xcb_render_composite(conn, XCB_RENDER_PICT_OP_OVER, picture, 0, picture, 0, 0, 0, 0, 0, 0, 0, 0);
-    xcb_flush(conn);
+    if (win == XCB_NONE)
+        return 0;
+    for (int i = 0; i < TOPLEVEL_CACHE_SIZE; i++)
+    {
+        if (toplevels[i].win == win)
+        {
+            *out = toplevels[i];
+            toplevels[i].win = XCB_NONE;
+            return 1;
+        }
+    }
+    return 0;
 }
 
 void toggle_fullscreen(xcb_connection_t *conn, xcb_screen_t *screen, Client *c)
 {
     if (!conn || !screen || !c)
     {
-        fprintf(stderr, "Error: Invalid parameter(s) in toggle_fullscreen\n");
+        log_error("Invalid parameter(s) in toggle_fullscreen");
         return;
     }
 
     if (c->state == STATE_NORMAL)
     {
-        xcb_get_geometry_cookie_t geo_cookie = xcb_get_geometry(conn, c->frame);
-        xcb_get_geometry_reply_t *geo = xcb_get_geometry_reply(conn, geo_cookie, NULL);
-        if (geo)
-        {
-            c->saved_x = geo->x;
-            c->saved_y = geo->y;
-            c->saved_w = geo->width;
-            c->saved_h = geo->height;
-            free(geo);
-            fprintf(stderr, "Info: Saved geometry for client (frame 0x%x)\n", c->frame);
-        }
-        else
-        {
-            fprintf(stderr, "Error: Could not get geometry for client (frame 0x%x)\n", c->frame);
-            return;
-        }
-
-        uint32_t values[4] = {0, 0, screen->width_in_pixels, screen->height_in_pixels};
+        layout_remove(c);
+        c->saved_x = c->x;
+        c->saved_y = c->y;
+        c->saved_w = c->width;
+        c->saved_h = c->height;
+        log_debug("Saved geometry for client (frame 0x%x)", c->frame);
+
+        /* Fill the monitor the window is (mostly) on */
+        const Output *out = output_for_rect(c->x, c->y, c->width, c->height);
+        uint32_t values[4] = {out->x, out->y, out->width, out->height};
         xcb_configure_window(conn, c->frame,
                              XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
                                  XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
@@ -105,8 +161,8 @@ void toggle_fullscreen(xcb_connection_t *conn, xcb_screen_t *screen, Client *c)
 
         values[0] = RESIZE_BORDER;
         values[1] = TITLE_BAR_HEIGHT;
-        values[2] = screen->width_in_pixels - 2 * RESIZE_BORDER;
-        values[3] = screen->height_in_pixels - TITLE_BAR_HEIGHT - RESIZE_BORDER;
+        values[2] = out->width - 2 * RESIZE_BORDER;
+        values[3] = out->height - TITLE_BAR_HEIGHT - RESIZE_BORDER;
         xcb_configure_window(conn, c->client,
                              XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
                                  XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
@@ -114,15 +170,24 @@ void toggle_fullscreen(xcb_connection_t *conn, xcb_screen_t *screen, Client *c)
 
         values[0] = RESIZE_BORDER;
         values[1] = 0;
-        values[2] = screen->width_in_pixels - 2 * RESIZE_BORDER;
+        values[2] = out->width - 2 * RESIZE_BORDER;
         values[3] = TITLE_BAR_HEIGHT;
         xcb_configure_window(conn, c->title,
                              XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
                                  XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
                              values);
 
+        c->x = out->x;
+        c->y = out->y;
+        c->width = out->width;
+        c->height = out->height;
         c->state = STATE_FULLSCREEN;
-        fprintf(stderr, "Info: Client (frame 0x%x) set to fullscreen\n", c->frame);
+        spatial_update(c);
+        stack_layer_changed(c);
+        /* Fullscreen windows are not resized; the handles go until restored */
+        for (int i = 0; i < RESIZE_HANDLES; i++)
+            xcb_unmap_window(conn, c->handles[i]);
+        log_info("Client (frame 0x%x) set to fullscreen", c->frame);
     }
     else
     {
@@ -141,47 +206,124 @@ void toggle_fullscreen(xcb_connection_t *conn, xcb_screen_t *screen, Client *c)
                                  XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
                              values);
 
+        c->x = c->saved_x;
+        c->y = c->saved_y;
+        c->width = c->saved_w;
+        c->height = c->saved_h;
         c->state = STATE_NORMAL;
-        fprintf(stderr, "Info: Client (frame 0x%x) restored to normal state\n", c->frame);
+        for (int i = 0; i < RESIZE_HANDLES; i++)
+            xcb_map_window(conn, c->handles[i]);
+        spatial_update(c);
+        stack_layer_changed(c);
+        layout_insert(c);
+        log_info("Client (frame 0x%x) restored to normal state", c->frame);
     }
 
-    /* Apply alpha blending to the client window */
-    uint8_t alpha_value = 0x80; // 50% opacity
-    apply_alpha_blending(conn, c->client, alpha_value);
+    title_invalidate(c);
 
-    /* Update rounded corners for the frame */
-    int frame_width = (c->state == STATE_NORMAL) ? c->saved_w : screen->width_in_pixels;
-    int frame_height = (c->state == STATE_NORMAL) ? c->saved_h : screen->height_in_pixels;
-    set_rounded_corners(conn, c->frame, frame_width, frame_height, CORNER_RADIUS);
-    xcb_flush(conn);
+    /* Update rounded corners for the frame; fullscreen frames are unshaped */
+    if (c->state == STATE_NORMAL)
+        set_rounded_corners(conn, c->frame, c->saved_w, c->saved_h, CORNER_RADIUS);
+    else
+        set_rounded_corners(conn, c->frame, c->width, c->height, 0);
 }
 
-void create_frame(xcb_connection_t *conn, xcb_screen_t *screen, xcb_window_t client)
+void client_configure(xcb_connection_t *conn, Client *c, int x, int y, int width, int height)
 {
-    if (!conn || !screen)
-    {
-        fprintf(stderr, "Error: Invalid connection or screen in create_frame\n");
+    if (width < MIN_WIDTH)
+        width = MIN_WIDTH;
+    if (height < MIN_HEIGHT)
+        height = MIN_HEIGHT;
+    int resized = width != c->width || height != c->height;
+    c->x = x;
+    c->y = y;
+    c->width = width;
+    c->height = height;
+    spatial_update(c);
+
+    uint32_t values[4] = {x, y, width, height};
+    xcb_configure_window(conn, c->frame,
+                         XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
+                             XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
+                         values);
+    if (!resized)
         return;
+
+    values[0] = width - 2 * RESIZE_BORDER;
+    xcb_configure_window(conn, c->title, XCB_CONFIG_WINDOW_WIDTH, values);
+    values[1] = height - TITLE_BAR_HEIGHT - RESIZE_BORDER;
+    xcb_configure_window(conn, c->client, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
+    set_rounded_corners(conn, c->frame, width, height, CORNER_RADIUS);
+    title_invalidate(c);
+}
+
+int client_handle_edges(const Client *c, xcb_window_t win)
+{
+    for (int i = 0; win != XCB_NONE && i < RESIZE_HANDLES; i++)
+    {
+        if (c->handles[i] == win)
+            return handle_specs[i].edges;
     }
+    return 0;
+}
 
-    /* Get client geometry */
-    xcb_get_geometry_cookie_t geom_cookie = xcb_get_geometry(conn, client);
-    xcb_get_geometry_reply_t *geom = xcb_get_geometry_reply(conn, geom_cookie, NULL);
-    if (!geom)
+xcb_cursor_t resize_cursor(int edges)
+{
+    for (int i = 0; i < RESIZE_HANDLES; i++)
     {
-        fprintf(stderr, "Error: Could not get geometry for client window 0x%x\n", client);
+        if (handle_specs[i].edges == edges)
+            return handle_cursors[i];
+    }
+    return XCB_NONE;
+}
+
+/* Loads the handle cursors from the cursor font, once */
+static void create_handle_cursors(xcb_connection_t *conn)
+{
+    if (handle_cursors[0] != XCB_NONE)
         return;
+    xcb_font_t font = res_new(conn, RES_FONT, XCB_NONE);
+    xcb_open_font(conn, font, strlen("cursor"), "cursor");
+    for (int i = 0; i < RESIZE_HANDLES; i++)
+    {
+        uint16_t glyph = handle_specs[i].glyph;
+        handle_cursors[i] = res_new(conn, RES_CURSOR, XCB_NONE);
+        xcb_create_glyph_cursor(conn, handle_cursors[i], font, font, glyph, glyph + 1,
+                                0, 0, 0, 0xFFFF, 0xFFFF, 0xFFFF);
     }
+    xcb_close_font(conn, font);
+    res_free(font);
+}
 
-    int frame_x = geom->x;
-    int frame_y = geom->y;
-    int client_width = geom->width;
-    int client_height = geom->height;
-    int frame_width = client_width + 2 * RESIZE_BORDER;
-    int frame_height = client_height + TITLE_BAR_HEIGHT + RESIZE_BORDER;
+/* Creates the resize handles inside a frame of the given size */
+static void create_handles(xcb_connection_t *conn, xcb_window_t frame, int width, int height,
+                           xcb_window_t *handles)
+{
+    create_handle_cursors(conn);
+    for (int i = 0; i < RESIZE_HANDLES; i++)
+    {
+        int edges = handle_specs[i].edges;
+        int corner = (edges & (RESIZE_LEFT | RESIZE_RIGHT)) && (edges & (RESIZE_TOP | RESIZE_BOTTOM));
+        int w = corner ? RESIZE_CORNER_SIZE : (edges & (RESIZE_LEFT | RESIZE_RIGHT)) ? RESIZE_HANDLE_WIDTH : HANDLE_SPAN;
+        int h = corner ? RESIZE_CORNER_SIZE : (edges & (RESIZE_TOP | RESIZE_BOTTOM)) ? RESIZE_HANDLE_WIDTH : HANDLE_SPAN;
+        int x = (edges & RESIZE_RIGHT) ? width - w : 0;
+        int y = (edges & RESIZE_BOTTOM) ? height - h : 0;
+
+        handles[i] = res_new_on(conn, RES_WINDOW, frame);
+        uint32_t values[2] = {handle_specs[i].gravity, handle_cursors[i]};
+        xcb_create_window(conn, 0, handles[i], frame, x, y, w, h, 0,
+                          XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT,
+                          XCB_CW_WIN_GRAVITY | XCB_CW_CURSOR, values);
+        xcb_map_window(conn, handles[i]);
+    }
+}
 
+/* Creates an unmapped frame window with its title bar and resize handles */
+static void create_frame_windows(xcb_connection_t *conn, xcb_screen_t *screen,
+                                 int x, int y, int width, int height, FramePair *out)
+{
     /* Create the frame window */
-    xcb_window_t frame = xcb_generate_id(conn);
+    xcb_window_t frame = res_new(conn, RES_WINDOW, XCB_NONE);
     uint32_t frame_mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
     uint32_t frame_values[2] = {screen->white_pixel,
                                 XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY |
@@ -189,25 +331,21 @@ void create_frame(xcb_connection_t *conn, xcb_screen_t *screen, xcb_window_t cli
                                     XCB_EVENT_MASK_EXPOSURE |
                                     XCB_EVENT_MASK_POINTER_MOTION};
     xcb_create_window(conn, XCB_COPY_FROM_PARENT, frame, screen->root,
-                      frame_x, frame_y,
-                      frame_width, frame_height,
+                      x, y,
+                      width, height,
                       0,
                       XCB_WINDOW_CLASS_INPUT_OUTPUT,
                       screen->root_visual,
                       frame_mask, frame_values);
-    fprintf(stderr, "Info: Created frame window 0x%x for client 0x%x\n", frame, client);
-
-    /* Apply rounded corners to the frame */
-    set_rounded_corners(conn, frame, frame_width, frame_height, CORNER_RADIUS);
 
     /* Create the title bar as a child of the frame */
-    xcb_window_t title = xcb_generate_id(conn);
+    xcb_window_t title = res_new_on(conn, RES_WINDOW, frame);
     uint32_t title_mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
-    uint32_t title_values[2] = {0xD0D0D0, /* light gray */
+    uint32_t title_values[2] = {TITLE_BG_COLOR,
                                 XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_BUTTON_PRESS};
     xcb_create_window(conn, XCB_COPY_FROM_PARENT, title, frame,
                       RESIZE_BORDER, 0,
-                      frame_width - 2 * RESIZE_BORDER, TITLE_BAR_HEIGHT,
+                      width - 2 * RESIZE_BORDER, TITLE_BAR_HEIGHT,
                       0,
                       XCB_WINDOW_CLASS_INPUT_OUTPUT,
                       screen->root_visual,
@@ -218,64 +356,276 @@ void create_frame(xcb_connection_t *conn, xcb_screen_t *screen, xcb_window_t cli
     xcb_change_property(conn, XCB_PROP_MODE_REPLACE, title,
                         XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8,
                         strlen(title_name), title_name);
-    fprintf(stderr, "Info: Title bar created for frame 0x%x\n", frame);
 
     /* Set the _NET_WM_WINDOW_OPACITY property for translucency on the title bar */
-    xcb_intern_atom_cookie_t opacity_cookie = xcb_intern_atom(conn, 0,
-                                                              strlen("_NET_WM_WINDOW_OPACITY"),
-                                                              "_NET_WM_WINDOW_OPACITY");
-    xcb_intern_atom_reply_t *opacity_reply = xcb_intern_atom_reply(conn, opacity_cookie, NULL);
-    if (opacity_reply)
+    if (atoms[ATOM_NET_WM_WINDOW_OPACITY] != XCB_ATOM_NONE)
     {
         // Set to half transparency (approximately 50% opacity)
         uint32_t opacity = 0x7FFFFFFF;
         xcb_change_property(conn, XCB_PROP_MODE_REPLACE, title,
-                            opacity_reply->atom, XCB_ATOM_CARDINAL, 32, 1, &opacity);
-        free(opacity_reply);
+                            atoms[ATOM_NET_WM_WINDOW_OPACITY], XCB_ATOM_CARDINAL, 32, 1, &opacity);
     }
     else
     {
-        fprintf(stderr, "Warning: Could not set window opacity for title bar (frame 0x%x)\n", frame);
+        log_warn("Could not set window opacity for title bar (frame 0x%x)", frame);
     }
 
-    /* Reparent the client window into the frame */
-    xcb_reparent_window(conn, client, frame, RESIZE_BORDER, TITLE_BAR_HEIGHT);
-    uint32_t border_width = 0;
-    xcb_configure_window(conn, client, XCB_CONFIG_WINDOW_BORDER_WIDTH, &border_width);
-
-    /* Map the client, title, and frame windows */
-    xcb_map_window(conn, client);
+    /* The title stays mapped; it shows whenever the frame is mapped */
     xcb_map_window(conn, title);
-    xcb_map_window(conn, frame);
-    xcb_flush(conn);
-    free(geom);
+    create_handles(conn, frame, width, height, out->handles);
+    frames_created++;
+    out->frame = frame;
+    out->title = title;
+}
 
-    /* Allocate and add a new Client record */
-    Client *c = malloc(sizeof(Client));
-    if (!c)
+void frame_pool_prewarm(xcb_connection_t *conn, xcb_screen_t *screen)
+{
+    while (frame_pool_len < FRAME_POOL_PREWARM)
     {
-        fprintf(stderr, "Error: Out of memory when allocating Client structure\n");
-        exit(EXIT_FAILURE);
+        FramePair pair;
+        create_frame_windows(conn, screen, 0, 0, MIN_WIDTH, MIN_HEIGHT, &pair);
+        frame_pool[frame_pool_len++] = pair;
+    }
+    if (frame_pool_len > frame_pool_high)
+        frame_pool_high = frame_pool_len;
+}
+
+static int frame_pool_take(FramePair *out)
+{
+    if (!frame_pool_len)
+        return 0;
+    *out = frame_pool[--frame_pool_len];
+    frames_reused++;
+    return 1;
+}
+
+void frame_pool_release(xcb_connection_t *conn, const Client *c)
+{
+    if (frame_pool_len == FRAME_POOL_SIZE)
+    {
+        xcb_destroy_window(conn, c->frame);
+        res_free(c->frame); /* And the title and handles with it */
+        frames_destroyed++;
+        return;
     }
+    xcb_unmap_window(conn, c->frame);
+    /* A frame released while fullscreen has its handles unmapped */
+    if (c->state == STATE_FULLSCREEN)
+    {
+        for (int i = 0; i < RESIZE_HANDLES; i++)
+            xcb_map_window(conn, c->handles[i]);
+    }
+    FramePair *pair = &frame_pool[frame_pool_len++];
+    pair->frame = c->frame;
+    pair->title = c->title;
+    memcpy(pair->handles, c->handles, sizeof(pair->handles));
+    if (frame_pool_len > frame_pool_high)
+        frame_pool_high = frame_pool_len;
+}
+
+int frame_pool_contains(xcb_window_t win)
+{
+    for (int i = 0; i < frame_pool_len; i++)
+    {
+        if (frame_pool[i].frame == win || frame_pool[i].title == win)
+            return 1;
+    }
+    return 0;
+}
+
+void frame_pool_report(FILE *out)
+{
+    fprintf(out, "etyWM Stats: frame pool %d/%d pooled (high-water %d), %lu created, %lu reused, %lu destroyed\n",
+            frame_pool_len, FRAME_POOL_SIZE, frame_pool_high, frames_created, frames_reused, frames_destroyed);
+}
+
+Client *create_frame(xcb_connection_t *conn, xcb_screen_t *screen, xcb_window_t client)
+{
+    if (!conn || !screen)
+    {
+        log_error("Invalid connection or screen in create_frame");
+        return NULL;
+    }
+
+    /* Get client geometry, from CreateNotify if we saw it */
+    ToplevelGeometry geom;
+    if (!take_toplevel_geometry(client, &geom))
+    {
+        xcb_get_geometry_cookie_t geom_cookie = xcb_get_geometry(conn, client);
+        stats_round_trip();
+        xcb_get_geometry_reply_t *reply = xcb_get_geometry_reply(conn, geom_cookie, NULL);
+        if (!reply)
+        {
+            log_error("Could not get geometry for client window 0x%x", client);
+            return NULL;
+        }
+        geom.x = reply->x;
+        geom.y = reply->y;
+        geom.width = reply->width;
+        geom.height = reply->height;
+        free(reply);
+    }
+
+    int frame_x = geom.x;
+    int frame_y = geom.y;
+    int client_width = geom.width;
+    int client_height = geom.height;
+    int frame_width = client_width + 2 * RESIZE_BORDER;
+    int frame_height = client_height + TITLE_BAR_HEIGHT + RESIZE_BORDER;
+
+    /* A window that left its position to the WM goes where it covers no
+     * other; windows being adopted keep theirs */
+    if (SMART_PLACEMENT && !adopting && frame_x == 0 && frame_y == 0)
+    {
+        const Output *o = output_for_rect(frame_x, frame_y, frame_width, frame_height);
+        if (spatial_find_free(o, frame_width, frame_height, &frame_x, &frame_y))
+            log_debug("Placed client 0x%x at %d,%d", client, frame_x, frame_y);
+    }
+
+    /* Take a frame from the pool if one is free; it only needs moving,
+     * resizing and raising. Otherwise create a fresh one. */
+    FramePair pair;
+    if (frame_pool_take(&pair))
+    {
+        uint32_t values[5] = {frame_x, frame_y, frame_width, frame_height, XCB_STACK_MODE_ABOVE};
+        xcb_configure_window(conn, pair.frame,
+                             XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
+                                 XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT |
+                                 XCB_CONFIG_WINDOW_STACK_MODE,
+                             values);
+        uint32_t title_width = frame_width - 2 * RESIZE_BORDER;
+        xcb_configure_window(conn, pair.title, XCB_CONFIG_WINDOW_WIDTH, &title_width);
+        log_info("Reusing pooled frame window 0x%x for client 0x%x", pair.frame, client);
+    }
+    else
+    {
+        create_frame_windows(conn, screen, frame_x, frame_y, frame_width, frame_height, &pair);
+        log_info("Created frame window 0x%x for client 0x%x", pair.frame, client);
+    }
+    xcb_window_t frame = pair.frame;
+    xcb_window_t title = pair.title;
+
+    /* Apply rounded corners to the frame */
+    set_rounded_corners(conn, frame, frame_width, frame_height, CORNER_RADIUS);
+
+    /* Follow the client's name for the title bar */
+    uint32_t client_mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+    xcb_change_window_attributes(conn, client, XCB_CW_EVENT_MASK, &client_mask);
+
+    /* Reparent the client window into the frame; the save-set hands it back
+     * to the root window if etyWM exits, so a restart can adopt it again */
+    xcb_change_save_set(conn, XCB_SET_MODE_INSERT, client);
+    xcb_reparent_window(conn, client, frame, RESIZE_BORDER, TITLE_BAR_HEIGHT);
+    /* Reparenting put it on top, above the resize handles, so the corner
+     * handles only take presses in the border and title bar */
+    uint32_t client_values[1] = {0};
+    xcb_configure_window(conn, client, XCB_CONFIG_WINDOW_BORDER_WIDTH, client_values);
+
+    /* Allocate and add a new Client record */
+    Client *c = client_alloc();
     c->client = client;
     c->frame = frame;
     c->title = title;
+    memcpy(c->handles, pair.handles, sizeof(c->handles));
+    c->x = frame_x;
+    c->y = frame_y;
+    c->width = frame_width;
+    c->height = frame_height;
     c->state = STATE_NORMAL;
-    c->next = NULL;
     add_client(c);
+    workspace_add_client(conn, c);
+    spatial_update(c);
+    stack_add(c);
+
+    /* Find out early whether the client can take part in synchronized resizes */
+    resize_sync_query(conn, c);
+    title_fetch(c);
+
+    /* Map the client and frame windows */
+    xcb_map_window(conn, client);
+    xcb_map_window(conn, frame);
+    layout_insert(c);
+    return c;
+}
+
+void adopt_existing_windows(xcb_connection_t *conn, xcb_screen_t *screen)
+{
+    xcb_query_tree_cookie_t tree_cookie = xcb_query_tree(conn, screen->root);
+    stats_round_trip();
+    xcb_query_tree_reply_t *tree = xcb_query_tree_reply(conn, tree_cookie, NULL);
+    if (!tree)
+    {
+        log_error("Could not query the root window's children");
+        return;
+    }
+
+    int n = xcb_query_tree_children_length(tree);
+    xcb_window_t *children = xcb_query_tree_children(tree);
+    xcb_get_window_attributes_cookie_t *attr_cookies = malloc(n * sizeof(*attr_cookies));
+    xcb_get_geometry_cookie_t *geom_cookies = malloc(n * sizeof(*geom_cookies));
+    if (n && (!attr_cookies || !geom_cookies))
+    {
+        log_error("Out of memory adopting %d windows", n);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Ask about every child at once; the replies come back together */
+    for (int i = 0; i < n; i++)
+    {
+        attr_cookies[i] = xcb_get_window_attributes(conn, children[i]);
+        geom_cookies[i] = xcb_get_geometry(conn, children[i]);
+    }
+    if (n)
+        stats_round_trip();
+
+    int adopted = 0;
+    for (int i = 0; i < n; i++)
+    {
+        xcb_get_window_attributes_reply_t *attr = xcb_get_window_attributes_reply(conn, attr_cookies[i], NULL);
+        xcb_get_geometry_reply_t *geom = xcb_get_geometry_reply(conn, geom_cookies[i], NULL);
+        xcb_window_t win = children[i];
+
+        /* Children come bottom to top, and each new frame goes on top, so
+         * the existing stacking order survives */
+        if (attr && geom && !attr->override_redirect && attr->map_state == XCB_MAP_STATE_VIEWABLE &&
+            !frame_pool_contains(win) && !find_client(win))
+        {
+            note_toplevel_geometry(win, geom->x, geom->y, geom->width, geom->height);
+            adopting = 1;
+            Client *c = create_frame(conn, screen, win);
+            adopting = 0;
+            /* Reparenting a mapped window unmaps it first */
+            if (c)
+            {
+                c->ignore_unmaps++;
+                adopted++;
+            }
+        }
+        free(attr);
+        free(geom);
+    }
+
+    log_info("Adopted %d of %d existing top-level windows", adopted, n);
+    free(attr_cookies);
+    free(geom_cookies);
+    free(tree);
 }
 
 void destroy_client(xcb_connection_t *conn, Client *c)
 {
     if (!conn || !c)
     {
-        fprintf(stderr, "Error: Invalid parameter(s) in destroy_client\n");
+        log_error("Invalid parameter(s) in destroy_client");
         return;
     }
 
-    fprintf(stderr, "Info: Destroying client (frame 0x%x, client 0x%x)\n", c->frame, c->client);
+    log_info("Destroying client (frame 0x%x, client 0x%x)", c->frame, c->client);
     xcb_kill_client(conn, c->client);
-    xcb_destroy_window(conn, c->frame);
-    xcb_flush(conn);
+    layout_remove(c);
+    spatial_remove(c);
+    stack_remove(c);
+    title_forget(c);
+    frame_pool_release(conn, c);
+    resize_sync_forget(conn, c);
     remove_client_by_frame(c->frame);
 }
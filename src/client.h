@@ -1,25 +1,87 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
+#include <stdio.h>
 #include <xcb/xcb.h>
 
+/* InputOnly resize handles on each frame: four edges and four corners */
+#define RESIZE_HANDLES 8
+
 /* Structure representing a managed client (window) */
 typedef struct Client {
     xcb_window_t client;
     xcb_window_t frame;
     xcb_window_t title;
+    xcb_window_t handles[RESIZE_HANDLES];
+    int x, y;             /* Frame geometry, as last sent to the server */
+    int width, height;
     int state;            /* STATE_NORMAL or STATE_FULLSCREEN */
+    int ignore_unmaps;    /* UnmapNotifys for the client caused by the WM itself */
+    int withdrawn;        /* Client unmapped itself; its frame stays hidden */
+    int workspace;        /* Workspace it is on (workspace.c) */
+    int tiled;            /* Placed by the layout (layout.c) rather than floating */
+    int tile_area;        /* Output it is tiled on */
+    struct Tile *tile;    /* Its leaf in LAYOUT_SPLIT */
     int saved_x, saved_y; /* Saved geometry for restoring from fullscreen */
     int saved_w, saved_h;
-    struct Client *next;
+    /* _NET_WM_SYNC_REQUEST state (resize_sync.c) */
+    uint32_t sync_counter;   /* Client's XSync counter, XCB_NONE if unsupported */
+    uint32_t sync_alarm;     /* Alarm armed while the client is being resized */
+    uint64_t sync_value;     /* Last counter value requested from the client */
+    int sync_query_pending;  /* Property replies below not yet collected */
+    unsigned int sync_protocols_seq, sync_counter_seq;
+    /* Title bar text (title.c) */
+    char *title_text;                     /* Client's name, UTF-8; NULL until read */
+    struct _cairo_surface *title_surface; /* cairo-xcb surface kept on 'title' */
+    int title_drawn_width;                /* Bar width at the last full draw */
+    int title_dirty;                      /* Work queued for titles_update() */
+    /* Spatial index (spatial.c) */
+    int grid_filed;                       /* Filed in the cells below */
+    int grid_x0, grid_y0, grid_x1, grid_y1;
+    /* Stacking (stack.c) */
+    int layer;            /* LAYER_* it sorts into */
+    int above;            /* Asked for _NET_WM_STATE_ABOVE */
+    int stack_index;      /* Position in the stacking order, 0 at the bottom */
+    int stack_sent;       /* Position the server has, during stack_update() */
+    int index;            /* Position in the client table (registry.c) */
 } Client;
 
-/* Client management functions */
+/* Client registry (registry.c): O(1) lookup by frame, title or client XID */
 void add_client(Client *c);
 void remove_client_by_frame(xcb_window_t frame);
 Client *find_client(xcb_window_t win);
-void create_frame(xcb_connection_t *conn, xcb_screen_t *screen, xcb_window_t client);
+int client_count(void);
+Client *client_at(int n);
+
+/* Slab allocation of Client records; records are returned to the slab by
+ * remove_client_by_frame() */
+Client *client_alloc(void);
+void client_slab_report(FILE *out);
+
+/* Geometry of top-level windows that are not managed yet, learned from
+ * CreateNotify/ConfigureNotify so create_frame() need not ask the server */
+void note_toplevel_geometry(xcb_window_t win, int x, int y, int width, int height);
+void forget_toplevel_geometry(xcb_window_t win);
+
+/* Pool of unmapped frame/title pairs that create_frame() reuses */
+void frame_pool_prewarm(xcb_connection_t *conn, xcb_screen_t *screen);
+void frame_pool_release(xcb_connection_t *conn, const Client *c);
+int frame_pool_contains(xcb_window_t win);
+void frame_pool_report(FILE *out);
+
+/* Client management functions */
+Client *create_frame(xcb_connection_t *conn, xcb_screen_t *screen, xcb_window_t client);
+void adopt_existing_windows(xcb_connection_t *conn, xcb_screen_t *screen);
 void destroy_client(xcb_connection_t *conn, Client *c);
 void toggle_fullscreen(xcb_connection_t *conn, xcb_screen_t *screen, Client *c);
 
+/* The RESIZE_* edges of the resize handle 'win' of 'c', or 0 if 'win' is
+ * not one of its handles; and the cursor shown over such a handle */
+int client_handle_edges(const Client *c, xcb_window_t win);
+xcb_cursor_t resize_cursor(int edges);
+
+/* Moves and resizes a client's frame (frame geometry, MIN_WIDTH/MIN_HEIGHT
+ * enforced); the title bar and client follow a size change */
+void client_configure(xcb_connection_t *conn, Client *c, int x, int y, int width, int height);
+
 #endif // CLIENT_H
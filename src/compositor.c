@@ -0,0 +1,857 @@
+#include "compositor.h"
+#include "atoms.h"
+#include "client.h"
+#include "draw.h"
+#include "resources.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+#include <xcb/xproto.h>
+#include <xcb/composite.h>
+#include <xcb/damage.h>
+#include <xcb/render.h>
+#include <xcb/shape.h>
+#include <xcb/xfixes.h>
+#include "log.h"
+
+#define OPAQUE 0xFFFFFFFFu
+
+/* Work left for compositor_paint(), which does it in one round trip */
+#define FETCH_ATTRS    (1 << 0) /* Class and visual: needed before drawing */
+#define FETCH_GEOMETRY (1 << 1) /* Size unknown (reparented to the root) */
+#define FETCH_OPACITY  (1 << 2)
+
+/* Geometry changes are collected client-side and sent as one region; past
+ * this many they are folded into their bounding box */
+#define MAX_DIRTY_RECTS 64
+
+/* A child of the root, in stacking order in 'wins' (bottom first) */
+typedef struct
+{
+    xcb_window_t win;
+    int x, y;          /* Outer corner, border included */
+    int width, height; /* Inside size */
+    int border;
+    int mapped;
+    int fetch;
+    int drawable;      /* InputOutput and its picture exists */
+    int argb;          /* Visual has an alpha channel */
+    uint32_t opacity;
+    xcb_window_t opacity_client; /* Client whose opacity a frame shows */
+    xcb_damage_damage_t damage;
+    xcb_render_picture_t picture; /* On the window, IncludeInferiors */
+    xcb_render_picture_t alpha;   /* Solid mask while opacity < OPAQUE */
+    xcb_xfixes_region_t clip;     /* Bounding shape, clipping 'picture' */
+} CompWindow;
+
+typedef struct
+{
+    xcb_visualid_t visual;
+    xcb_render_pictformat_t format;
+    int alpha;
+} VisualFormat;
+
+static int active = 0;
+static xcb_window_t root = XCB_NONE;
+static xcb_window_t overlay = XCB_NONE;
+static xcb_window_t cm_owner = XCB_NONE;
+static uint8_t damage_first_event = 0;
+static int shape_events = 0;
+static uint8_t shape_first_event = 0;
+
+static VisualFormat *formats = NULL;
+static int formats_len = 0;
+static xcb_render_pictformat_t root_format = XCB_NONE;
+static uint8_t root_depth = 0;
+
+static CompWindow *wins = NULL;
+static int wins_len = 0;
+static int wins_cap = 0;
+
+static int screen_width = 0, screen_height = 0;
+static xcb_pixmap_t back_pixmap = XCB_NONE;
+static xcb_render_picture_t back = XCB_NONE;
+static xcb_render_picture_t overlay_picture = XCB_NONE;
+static xcb_render_picture_t black = XCB_NONE;
+static xcb_pixmap_t bg_pixmap = XCB_NONE;
+static xcb_render_picture_t bg_picture = XCB_NONE;
+
+/* Damaged area: window damage goes straight into the server-side region,
+ * geometry changes wait in 'rects'. The bounding box of both lets the paint
+ * skip windows and pixels nothing touched. */
+static xcb_xfixes_region_t dirty_region = XCB_NONE;
+static xcb_xfixes_region_t scratch_region = XCB_NONE;
+static xcb_rectangle_t rects[MAX_DIRTY_RECTS];
+static int rects_len = 0;
+static int dirty = 0;
+static int dirty_x1, dirty_y1, dirty_x2, dirty_y2;
+
+static unsigned long paints = 0;
+static unsigned long windows_drawn = 0;
+static unsigned long long pixels_drawn = 0;
+
+static const VisualFormat *format_for_visual(xcb_visualid_t visual)
+{
+    for (int i = 0; i < formats_len; i++)
+    {
+        if (formats[i].visual == visual)
+            return &formats[i];
+    }
+    return NULL;
+}
+
+/* Builds the visual -> picture format table for the screen's visuals */
+static int read_formats(xcb_render_query_pict_formats_reply_t *r)
+{
+    xcb_render_pictforminfo_t *infos = xcb_render_query_pict_formats_formats(r);
+    int ninfos = xcb_render_query_pict_formats_formats_length(r);
+
+    free(formats);
+    formats = malloc(r->num_visuals * sizeof(*formats));
+    if (r->num_visuals && !formats)
+    {
+        log_error("Out of memory reading picture formats");
+        exit(EXIT_FAILURE);
+    }
+    formats_len = 0;
+
+    for (xcb_render_pictscreen_iterator_t s = xcb_render_query_pict_formats_screens_iterator(r); s.rem;
+         xcb_render_pictscreen_next(&s))
+    {
+        for (xcb_render_pictdepth_iterator_t d = xcb_render_pictscreen_depths_iterator(s.data); d.rem;
+             xcb_render_pictdepth_next(&d))
+        {
+            for (xcb_render_pictvisual_iterator_t v = xcb_render_pictdepth_visuals_iterator(d.data); v.rem;
+                 xcb_render_pictvisual_next(&v))
+            {
+                if (formats_len == (int)r->num_visuals)
+                    break;
+                VisualFormat *f = &formats[formats_len++];
+                f->visual = v.data->visual;
+                f->format = v.data->format;
+                f->alpha = 0;
+                for (int i = 0; i < ninfos; i++)
+                {
+                    if (infos[i].id == f->format)
+                        f->alpha = infos[i].direct.alpha_mask != 0;
+                }
+            }
+        }
+    }
+    return formats_len;
+}
+
+static void add_dirty(int x, int y, int width, int height)
+{
+    if (width <= 0 || height <= 0)
+        return;
+    if (!dirty)
+    {
+        dirty_x1 = x;
+        dirty_y1 = y;
+        dirty_x2 = x + width;
+        dirty_y2 = y + height;
+        dirty = 1;
+    }
+    else
+    {
+        if (x < dirty_x1)
+            dirty_x1 = x;
+        if (y < dirty_y1)
+            dirty_y1 = y;
+        if (x + width > dirty_x2)
+            dirty_x2 = x + width;
+        if (y + height > dirty_y2)
+            dirty_y2 = y + height;
+    }
+}
+
+/* Marks a rectangle of the screen for repaint */
+static void damage_rect(int x, int y, int width, int height)
+{
+    if (!active || width <= 0 || height <= 0)
+        return;
+    add_dirty(x, y, width, height);
+    if (rects_len == MAX_DIRTY_RECTS)
+    {
+        rects[0] = (xcb_rectangle_t){ dirty_x1, dirty_y1, dirty_x2 - dirty_x1, dirty_y2 - dirty_y1 };
+        rects_len = 1;
+        return;
+    }
+    rects[rects_len++] = (xcb_rectangle_t){ x, y, width, height };
+}
+
+static void damage_window(const CompWindow *w)
+{
+    if (w->mapped)
+        damage_rect(w->x, w->y, w->width + 2 * w->border, w->height + 2 * w->border);
+}
+
+static int find_window(xcb_window_t win)
+{
+    for (int i = 0; i < wins_len; i++)
+    {
+        if (wins[i].win == win)
+            return i;
+    }
+    return -1;
+}
+
+/* Adds a window on top of the stack */
+static CompWindow *add_window(xcb_window_t win, int x, int y, int width, int height, int border)
+{
+    if (win == overlay || win == cm_owner || find_window(win) >= 0)
+        return NULL;
+    if (wins_len == wins_cap)
+    {
+        int cap = wins_cap ? wins_cap * 2 : 64;
+        CompWindow *grown = realloc(wins, cap * sizeof(*wins));
+        if (!grown)
+        {
+            log_error("Out of memory tracking window 0x%x", win);
+            exit(EXIT_FAILURE);
+        }
+        wins = grown;
+        wins_cap = cap;
+    }
+    CompWindow *w = &wins[wins_len++];
+    memset(w, 0, sizeof(*w));
+    w->win = win;
+    w->x = x;
+    w->y = y;
+    w->width = width;
+    w->height = height;
+    w->border = border;
+    w->opacity = OPAQUE;
+    w->fetch = FETCH_ATTRS | FETCH_OPACITY;
+    return w;
+}
+
+/* Forgets a window. Its damage object and picture die with it on the
+ * server; only the mask is ours to free. */
+static void remove_window(xcb_connection_t *conn, int i, int destroyed)
+{
+    CompWindow *w = &wins[i];
+    damage_window(w);
+    if (!destroyed && w->drawable)
+    {
+        xcb_damage_destroy(conn, w->damage);
+        res_free(w->damage);
+        xcb_render_free_picture(conn, w->picture);
+        res_free(w->picture);
+    }
+    if (w->alpha != XCB_NONE)
+    {
+        xcb_render_free_picture(conn, w->alpha);
+        res_free(w->alpha);
+    }
+    if (w->clip != XCB_NONE)
+    {
+        xcb_xfixes_destroy_region(conn, w->clip);
+        res_free(w->clip);
+    }
+    memmove(&wins[i], &wins[i + 1], (wins_len - i - 1) * sizeof(*wins));
+    wins_len--;
+}
+
+/* Moves wins[i] directly above 'sibling', or to the bottom for XCB_NONE;
+ * returns its new index */
+static int restack(int i, xcb_window_t sibling)
+{
+    CompWindow w = wins[i];
+    memmove(&wins[i], &wins[i + 1], (wins_len - i - 1) * sizeof(*wins));
+    wins_len--;
+
+    int to = 0;
+    if (sibling != XCB_NONE)
+    {
+        int s = find_window(sibling);
+        to = s >= 0 ? s + 1 : wins_len;
+    }
+    memmove(&wins[to + 1], &wins[to], (wins_len - to) * sizeof(*wins));
+    wins[to] = w;
+    wins_len++;
+    return to;
+}
+
+/* (Re)reads the window's bounding shape into the clip of its picture, so
+ * the parts outside it (a frame's rounded corners) are never drawn */
+static void update_clip(xcb_connection_t *conn, CompWindow *w)
+{
+    if (w->clip != XCB_NONE)
+    {
+        xcb_xfixes_destroy_region(conn, w->clip);
+        res_free(w->clip);
+    }
+    w->clip = res_new(conn, RES_REGION, XCB_NONE);
+    xcb_xfixes_create_region_from_window(conn, w->clip, w->win, XCB_SHAPE_SK_BOUNDING);
+    xcb_xfixes_set_picture_clip_region(conn, w->picture, w->clip, 0, 0);
+}
+
+/* Creates the damage object and picture once the window's visual is known */
+static void make_drawable(xcb_connection_t *conn, CompWindow *w, const xcb_get_window_attributes_reply_t *attrs)
+{
+    if (attrs->_class == XCB_WINDOW_CLASS_INPUT_ONLY)
+        return;
+    const VisualFormat *f = format_for_visual(attrs->visual);
+    if (!f)
+    {
+        log_warn("No picture format for visual 0x%x of window 0x%x", attrs->visual, w->win);
+        return;
+    }
+    w->argb = f->alpha;
+
+    w->damage = res_new_on(conn, RES_DAMAGE, w->win);
+    xcb_damage_create(conn, w->damage, w->win, XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+
+    uint32_t mode = XCB_RENDER_SUBWINDOW_MODE_INCLUDE_INFERIORS;
+    w->picture = res_new_on(conn, RES_PICTURE, w->win);
+    xcb_render_create_picture(conn, w->picture, w->win, f->format, XCB_RENDER_CP_SUBWINDOW_MODE, &mode);
+    if (shape_events)
+        xcb_shape_select_input(conn, w->win, 1);
+    update_clip(conn, w);
+    w->drawable = 1;
+    damage_window(w);
+}
+
+static void set_opacity(xcb_connection_t *conn, CompWindow *w, uint32_t opacity)
+{
+    if (opacity == w->opacity)
+        return;
+    w->opacity = opacity;
+    if (w->alpha != XCB_NONE)
+    {
+        xcb_render_free_picture(conn, w->alpha);
+        res_free(w->alpha);
+        w->alpha = XCB_NONE;
+    }
+    if (opacity != OPAQUE)
+    {
+        xcb_render_color_t color = { 0, 0, 0, opacity >> 16 };
+        w->alpha = res_new(conn, RES_PICTURE, XCB_NONE);
+        xcb_render_create_solid_fill(conn, w->alpha, color);
+    }
+    damage_window(w);
+}
+
+static uint32_t read_opacity(xcb_get_property_reply_t *r)
+{
+    if (r && r->type == XCB_ATOM_CARDINAL && r->format == 32 && xcb_get_property_value_length(r) >= 4)
+        return *(uint32_t *)xcb_get_property_value(r);
+    return OPAQUE;
+}
+
+/* Sends every queued attribute, geometry and opacity request, then reads
+ * the replies: one round trip however many windows are waiting */
+static void resolve_fetches(xcb_connection_t *conn)
+{
+    int waiting = 0;
+    for (int i = 0; i < wins_len; i++)
+        waiting += wins[i].fetch != 0;
+    if (!waiting)
+        return;
+
+    typedef struct
+    {
+        xcb_window_t win;
+        int fetch;
+        xcb_get_window_attributes_cookie_t attrs;
+        xcb_get_geometry_cookie_t geometry;
+        xcb_get_property_cookie_t opacity, client_opacity;
+        int has_client;
+    } Fetch;
+    Fetch *f = malloc(waiting * sizeof(*f));
+    if (!f)
+    {
+        log_error("Out of memory reading %d windows", waiting);
+        exit(EXIT_FAILURE);
+    }
+
+    int n = 0;
+    for (int i = 0; i < wins_len; i++)
+    {
+        CompWindow *w = &wins[i];
+        if (!w->fetch)
+            continue;
+        Fetch *q = &f[n++];
+        q->win = w->win;
+        q->fetch = w->fetch;
+        q->has_client = 0;
+        if (w->fetch & FETCH_ATTRS)
+            q->attrs = xcb_get_window_attributes(conn, w->win);
+        if (w->fetch & FETCH_GEOMETRY)
+            q->geometry = xcb_get_geometry(conn, w->win);
+        if ((w->fetch & FETCH_OPACITY) && atoms[ATOM_NET_WM_WINDOW_OPACITY] != XCB_ATOM_NONE)
+        {
+            q->opacity = xcb_get_property(conn, 0, w->win, atoms[ATOM_NET_WM_WINDOW_OPACITY],
+                                          XCB_ATOM_CARDINAL, 0, 1);
+            /* Clients set it on their own window; a frame shows theirs */
+            Client *c = find_client(w->win);
+            if (c && c->frame == w->win)
+            {
+                q->client_opacity = xcb_get_property(conn, 0, c->client, atoms[ATOM_NET_WM_WINDOW_OPACITY],
+                                                     XCB_ATOM_CARDINAL, 0, 1);
+                q->has_client = 1;
+                w->opacity_client = c->client;
+            }
+        }
+        else
+        {
+            q->fetch &= ~FETCH_OPACITY;
+        }
+        w->fetch = 0;
+    }
+    stats_round_trip();
+
+    for (int k = 0; k < n; k++)
+    {
+        Fetch *q = &f[k];
+        xcb_get_window_attributes_reply_t *attrs = NULL;
+        xcb_get_geometry_reply_t *geom = NULL;
+        xcb_get_property_reply_t *op = NULL, *client_op = NULL;
+        if (q->fetch & FETCH_ATTRS)
+            attrs = xcb_get_window_attributes_reply(conn, q->attrs, NULL);
+        if (q->fetch & FETCH_GEOMETRY)
+            geom = xcb_get_geometry_reply(conn, q->geometry, NULL);
+        if (q->fetch & FETCH_OPACITY)
+        {
+            op = xcb_get_property_reply(conn, q->opacity, NULL);
+            if (q->has_client)
+                client_op = xcb_get_property_reply(conn, q->client_opacity, NULL);
+        }
+
+        /* The window may have gone while we waited */
+        int i = find_window(q->win);
+        if (i >= 0)
+        {
+            CompWindow *w = &wins[i];
+            if (geom)
+            {
+                damage_window(w);
+                w->x = geom->x;
+                w->y = geom->y;
+                w->width = geom->width;
+                w->height = geom->height;
+                w->border = geom->border_width;
+                damage_window(w);
+            }
+            if (attrs)
+                make_drawable(conn, w, attrs);
+            if (q->fetch & FETCH_OPACITY)
+            {
+                uint32_t opacity = read_opacity(op);
+                if (opacity == OPAQUE && client_op)
+                    opacity = read_opacity(client_op);
+                set_opacity(conn, w, opacity);
+            }
+        }
+        free(attrs);
+        free(geom);
+        free(op);
+        free(client_op);
+    }
+    free(f);
+}
+
+/* (Re)creates the back buffer at the current screen size */
+static void create_back_buffer(xcb_connection_t *conn)
+{
+    if (back != XCB_NONE)
+    {
+        xcb_render_free_picture(conn, back);
+        res_free(back);
+        xcb_free_pixmap(conn, back_pixmap);
+        res_free(back_pixmap);
+    }
+    back_pixmap = res_new(conn, RES_PIXMAP, XCB_NONE);
+    xcb_create_pixmap(conn, root_depth, back_pixmap, root, screen_width, screen_height);
+    back = res_new(conn, RES_PICTURE, XCB_NONE);
+    xcb_render_create_picture(conn, back, back_pixmap, root_format, 0, NULL);
+}
+
+/* Tracks the root's current children: one round trip for the tree, one for
+ * all their attributes and geometry together */
+static void scan_windows(xcb_connection_t *conn)
+{
+    xcb_query_tree_cookie_t tree_cookie = xcb_query_tree(conn, root);
+    stats_round_trip();
+    xcb_query_tree_reply_t *tree = xcb_query_tree_reply(conn, tree_cookie, NULL);
+    if (!tree)
+        return;
+
+    int n = xcb_query_tree_children_length(tree);
+    xcb_window_t *children = xcb_query_tree_children(tree);
+    xcb_get_window_attributes_cookie_t *attr_cookies = malloc(n * sizeof(*attr_cookies));
+    xcb_get_geometry_cookie_t *geom_cookies = malloc(n * sizeof(*geom_cookies));
+    if (n && (!attr_cookies || !geom_cookies))
+    {
+        log_error("Out of memory scanning %d windows", n);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        attr_cookies[i] = xcb_get_window_attributes(conn, children[i]);
+        geom_cookies[i] = xcb_get_geometry(conn, children[i]);
+    }
+    if (n)
+        stats_round_trip();
+
+    for (int i = 0; i < n; i++)
+    {
+        xcb_get_window_attributes_reply_t *attrs = xcb_get_window_attributes_reply(conn, attr_cookies[i], NULL);
+        xcb_get_geometry_reply_t *geom = xcb_get_geometry_reply(conn, geom_cookies[i], NULL);
+        if (attrs && geom)
+        {
+            CompWindow *w = add_window(children[i], geom->x, geom->y, geom->width, geom->height,
+                                       geom->border_width);
+            if (w)
+            {
+                w->mapped = attrs->map_state == XCB_MAP_STATE_VIEWABLE;
+                w->fetch &= ~FETCH_ATTRS;
+                make_drawable(conn, w, attrs);
+            }
+        }
+        free(attrs);
+        free(geom);
+    }
+    free(attr_cookies);
+    free(geom_cookies);
+    free(tree);
+}
+
+int compositor_init(xcb_connection_t *conn, xcb_screen_t *screen)
+{
+    const xcb_query_extension_reply_t *composite = xcb_get_extension_data(conn, &xcb_composite_id);
+    const xcb_query_extension_reply_t *damage = xcb_get_extension_data(conn, &xcb_damage_id);
+    const xcb_query_extension_reply_t *xfixes = xcb_get_extension_data(conn, &xcb_xfixes_id);
+    const xcb_query_extension_reply_t *render = xcb_get_extension_data(conn, &xcb_render_id);
+    if (!composite || !composite->present || !damage || !damage->present ||
+        !xfixes || !xfixes->present || !render || !render->present)
+    {
+        log_warn("Composite, Damage, XFixes or Render missing; not compositing");
+        return 0;
+    }
+    if (atoms[ATOM_NET_WM_CM_S0] == XCB_ATOM_NONE)
+        return 0;
+    damage_first_event = damage->first_event;
+    /* Without Shape every window is a plain rectangle and never changes */
+    const xcb_query_extension_reply_t *shape = xcb_get_extension_data(conn, &xcb_shape_id);
+    shape_events = shape && shape->present;
+    if (shape_events)
+        shape_first_event = shape->first_event;
+    root = screen->root;
+    root_depth = screen->root_depth;
+
+    /* Damage and XFixes must be told our version before use; their replies
+     * are not needed since requests are processed in order */
+    xcb_discard_reply(conn, xcb_composite_query_version(conn, 0, 4).sequence);
+    xcb_discard_reply(conn, xcb_damage_query_version(conn, 1, 1).sequence);
+    xcb_discard_reply(conn, xcb_xfixes_query_version(conn, 2, 0).sequence);
+    xcb_get_selection_owner_cookie_t owner_cookie = xcb_get_selection_owner(conn, atoms[ATOM_NET_WM_CM_S0]);
+    xcb_render_query_pict_formats_cookie_t formats_cookie = xcb_render_query_pict_formats(conn);
+    stats_round_trip();
+
+    xcb_get_selection_owner_reply_t *owner = xcb_get_selection_owner_reply(conn, owner_cookie, NULL);
+    xcb_render_query_pict_formats_reply_t *pict_formats = xcb_render_query_pict_formats_reply(conn, formats_cookie, NULL);
+    int taken = owner && owner->owner != XCB_NONE;
+    free(owner);
+    if (taken || !pict_formats || !read_formats(pict_formats))
+    {
+        if (taken)
+            log_info("Another compositor is running; leaving compositing to it");
+        else
+            log_warn("Could not read picture formats; not compositing");
+        free(pict_formats);
+        return 0;
+    }
+    free(pict_formats);
+
+    const VisualFormat *rf = format_for_visual(screen->root_visual);
+    if (!rf)
+    {
+        log_warn("No picture format for the root visual; not compositing");
+        return 0;
+    }
+    root_format = rf->format;
+
+    /* Announce ourselves so external compositors back off */
+    cm_owner = res_new(conn, RES_WINDOW, XCB_NONE);
+    xcb_create_window(conn, XCB_COPY_FROM_PARENT, cm_owner, root, -1, -1, 1, 1, 0,
+                      XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT, 0, NULL);
+    xcb_set_selection_owner(conn, cm_owner, atoms[ATOM_NET_WM_CM_S0], XCB_CURRENT_TIME);
+
+    xcb_composite_redirect_subwindows(conn, root, XCB_COMPOSITE_REDIRECT_MANUAL);
+    xcb_composite_get_overlay_window_cookie_t overlay_cookie = xcb_composite_get_overlay_window(conn, root);
+    stats_round_trip();
+    xcb_composite_get_overlay_window_reply_t *ov = xcb_composite_get_overlay_window_reply(conn, overlay_cookie, NULL);
+    if (!ov)
+    {
+        log_error("Could not get the composite overlay window");
+        xcb_composite_unredirect_subwindows(conn, root, XCB_COMPOSITE_REDIRECT_MANUAL);
+        xcb_destroy_window(conn, cm_owner);
+        res_free(cm_owner);
+        cm_owner = XCB_NONE;
+        return 0;
+    }
+    overlay = ov->overlay_win;
+    free(ov);
+
+    /* Clicks go through the overlay to the windows drawn on it */
+    xcb_xfixes_region_t empty = res_new(conn, RES_REGION, XCB_NONE);
+    xcb_xfixes_create_region(conn, empty, 0, NULL);
+    xcb_xfixes_set_window_shape_region(conn, overlay, XCB_SHAPE_SK_INPUT, 0, 0, empty);
+    xcb_xfixes_destroy_region(conn, empty);
+    res_free(empty);
+
+    overlay_picture = res_new_on(conn, RES_PICTURE, overlay);
+    xcb_render_create_picture(conn, overlay_picture, overlay, root_format, 0, NULL);
+    xcb_render_color_t opaque_black = { 0, 0, 0, 0xFFFF };
+    black = res_new(conn, RES_PICTURE, XCB_NONE);
+    xcb_render_create_solid_fill(conn, black, opaque_black);
+
+    dirty_region = res_new(conn, RES_REGION, XCB_NONE);
+    xcb_xfixes_create_region(conn, dirty_region, 0, NULL);
+    scratch_region = res_new(conn, RES_REGION, XCB_NONE);
+    xcb_xfixes_create_region(conn, scratch_region, 0, NULL);
+
+    active = 1;
+    compositor_screen_changed(conn, screen);
+    scan_windows(conn);
+    log_info("Compositing %d windows", wins_len);
+    return 1;
+}
+
+void compositor_screen_changed(xcb_connection_t *conn, xcb_screen_t *screen)
+{
+    if (!active)
+        return;
+    if (screen->width_in_pixels != screen_width || screen->height_in_pixels != screen_height)
+    {
+        screen_width = screen->width_in_pixels;
+        screen_height = screen->height_in_pixels;
+        create_back_buffer(conn);
+    }
+    damage_rect(0, 0, screen_width, screen_height);
+}
+
+void compositor_handle_event(xcb_connection_t *conn, xcb_generic_event_t *ev)
+{
+    if (!active)
+        return;
+
+    uint8_t type = ev->response_type & ~0x80;
+    if (type == damage_first_event + XCB_DAMAGE_NOTIFY)
+    {
+        xcb_damage_notify_event_t *dn = (xcb_damage_notify_event_t *)ev;
+        int i = find_window(dn->drawable);
+        if (i < 0)
+            return;
+        CompWindow *w = &wins[i];
+        /* Take the parts into the screen-space dirty region; this also
+         * re-arms the damage object for the next report */
+        xcb_damage_subtract(conn, w->damage, XCB_NONE, scratch_region);
+        xcb_xfixes_translate_region(conn, scratch_region, w->x + w->border, w->y + w->border);
+        xcb_xfixes_union_region(conn, dirty_region, scratch_region, dirty_region);
+        if (w->mapped)
+            add_dirty(w->x + w->border + dn->area.x, w->y + w->border + dn->area.y,
+                      dn->area.width, dn->area.height);
+        return;
+    }
+    if (shape_events && type == shape_first_event + XCB_SHAPE_NOTIFY)
+    {
+        xcb_shape_notify_event_t *sn = (xcb_shape_notify_event_t *)ev;
+        int i = find_window(sn->affected_window);
+        if (i >= 0 && wins[i].drawable && sn->shape_kind == XCB_SHAPE_SK_BOUNDING)
+        {
+            update_clip(conn, &wins[i]);
+            damage_window(&wins[i]);
+        }
+        return;
+    }
+
+    switch (type)
+    {
+    case XCB_CREATE_NOTIFY:
+    {
+        xcb_create_notify_event_t *cn = (xcb_create_notify_event_t *)ev;
+        if (cn->parent == root)
+            add_window(cn->window, cn->x, cn->y, cn->width, cn->height, cn->border_width);
+        break;
+    }
+    case XCB_DESTROY_NOTIFY:
+    {
+        xcb_destroy_notify_event_t *dn = (xcb_destroy_notify_event_t *)ev;
+        int i = dn->event == root ? find_window(dn->window) : -1;
+        if (i >= 0)
+            remove_window(conn, i, 1);
+        break;
+    }
+    case XCB_MAP_NOTIFY:
+    {
+        xcb_map_notify_event_t *mn = (xcb_map_notify_event_t *)ev;
+        int i = mn->event == root ? find_window(mn->window) : -1;
+        if (i >= 0)
+        {
+            wins[i].mapped = 1;
+            damage_window(&wins[i]);
+            /* Pooled frames change hands: a frame may map with a new client
+             * in it, whose opacity was set before it mapped */
+            Client *c = find_client(mn->window);
+            if (c && c->frame == mn->window && c->client != wins[i].opacity_client)
+                wins[i].fetch |= FETCH_OPACITY;
+        }
+        break;
+    }
+    case XCB_UNMAP_NOTIFY:
+    {
+        xcb_unmap_notify_event_t *un = (xcb_unmap_notify_event_t *)ev;
+        int i = un->event == root ? find_window(un->window) : -1;
+        if (i >= 0)
+        {
+            damage_window(&wins[i]);
+            wins[i].mapped = 0;
+        }
+        break;
+    }
+    case XCB_CONFIGURE_NOTIFY:
+    {
+        xcb_configure_notify_event_t *cfg = (xcb_configure_notify_event_t *)ev;
+        int i = cfg->event == root ? find_window(cfg->window) : -1;
+        if (i < 0)
+            break;
+        CompWindow *w = &wins[i];
+        damage_window(w);
+        w->x = cfg->x;
+        w->y = cfg->y;
+        w->width = cfg->width;
+        w->height = cfg->height;
+        w->border = cfg->border_width;
+        damage_window(&wins[restack(i, cfg->above_sibling)]);
+        break;
+    }
+    case XCB_CIRCULATE_NOTIFY:
+    {
+        xcb_circulate_notify_event_t *ci = (xcb_circulate_notify_event_t *)ev;
+        int i = ci->event == root ? find_window(ci->window) : -1;
+        if (i < 0)
+            break;
+        xcb_window_t below = ci->place == XCB_PLACE_ON_TOP ? wins[wins_len - 1].win : XCB_NONE;
+        if (below != ci->window)
+            damage_window(&wins[restack(i, below)]);
+        break;
+    }
+    case XCB_REPARENT_NOTIFY:
+    {
+        xcb_reparent_notify_event_t *rn = (xcb_reparent_notify_event_t *)ev;
+        if (rn->event != root)
+            break;
+        int i = find_window(rn->window);
+        if (rn->parent == root)
+        {
+            CompWindow *w = add_window(rn->window, rn->x, rn->y, 0, 0, 0);
+            if (w)
+                w->fetch |= FETCH_GEOMETRY;
+        }
+        else if (i >= 0)
+        {
+            remove_window(conn, i, 0);
+        }
+        break;
+    }
+    case XCB_PROPERTY_NOTIFY:
+    {
+        xcb_property_notify_event_t *pn = (xcb_property_notify_event_t *)ev;
+        if (pn->atom != atoms[ATOM_NET_WM_WINDOW_OPACITY])
+            break;
+        int i = find_window(pn->window);
+        if (i < 0)
+        {
+            Client *c = find_client(pn->window);
+            if (c && pn->window == c->client)
+                i = find_window(c->frame);
+        }
+        if (i >= 0)
+            wins[i].fetch |= FETCH_OPACITY;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void compositor_paint(xcb_connection_t *conn)
+{
+    if (!active)
+        return;
+    resolve_fetches(conn);
+    if (!dirty)
+        return;
+
+    if (rects_len)
+    {
+        xcb_xfixes_set_region(conn, scratch_region, rects_len, rects);
+        xcb_xfixes_union_region(conn, dirty_region, scratch_region, dirty_region);
+    }
+
+    /* The wallpaper may have been replaced by set_root_background() */
+    xcb_pixmap_t bg = root_background();
+    if (bg != bg_pixmap)
+    {
+        if (bg_picture != XCB_NONE)
+        {
+            xcb_render_free_picture(conn, bg_picture);
+            res_free(bg_picture);
+        }
+        bg_picture = XCB_NONE;
+        bg_pixmap = bg;
+        if (bg != XCB_NONE)
+        {
+            bg_picture = res_new(conn, RES_PICTURE, XCB_NONE);
+            xcb_render_create_picture(conn, bg_picture, bg, root_format, 0, NULL);
+        }
+    }
+
+    int x1 = dirty_x1 > 0 ? dirty_x1 : 0;
+    int y1 = dirty_y1 > 0 ? dirty_y1 : 0;
+    int x2 = dirty_x2 < screen_width ? dirty_x2 : screen_width;
+    int y2 = dirty_y2 < screen_height ? dirty_y2 : screen_height;
+    if (x2 > x1 && y2 > y1)
+    {
+        xcb_xfixes_set_picture_clip_region(conn, back, dirty_region, 0, 0);
+        xcb_render_composite(conn, XCB_RENDER_PICT_OP_SRC, bg_picture != XCB_NONE ? bg_picture : black,
+                             XCB_NONE, back, x1, y1, 0, 0, x1, y1, x2 - x1, y2 - y1);
+
+        for (int i = 0; i < wins_len; i++)
+        {
+            const CompWindow *w = &wins[i];
+            int wx = w->x + w->border, wy = w->y + w->border;
+            if (!w->mapped || !w->drawable || w->opacity == 0 ||
+                wx >= x2 || wy >= y2 || wx + w->width <= x1 || wy + w->height <= y1)
+                continue;
+            uint8_t op = (w->argb || w->alpha != XCB_NONE) ? XCB_RENDER_PICT_OP_OVER : XCB_RENDER_PICT_OP_SRC;
+            xcb_render_composite(conn, op, w->picture, w->alpha, back, 0, 0, 0, 0, wx, wy,
+                                 w->width, w->height);
+            windows_drawn++;
+        }
+
+        xcb_xfixes_set_picture_clip_region(conn, overlay_picture, dirty_region, 0, 0);
+        xcb_render_composite(conn, XCB_RENDER_PICT_OP_SRC, back, XCB_NONE, overlay_picture,
+                             x1, y1, 0, 0, x1, y1, x2 - x1, y2 - y1);
+        paints++;
+        pixels_drawn += (unsigned long long)(x2 - x1) * (y2 - y1);
+    }
+
+    xcb_xfixes_set_region(conn, dirty_region, 0, NULL);
+    rects_len = 0;
+    dirty = 0;
+}
+
+void compositor_report(FILE *out)
+{
+    if (!active)
+        return;
+    fprintf(out, "etyWM Stats: compositor %lu paints, %lu windows drawn, %llu pixels, %d windows tracked\n",
+            paints, windows_drawn, pixels_drawn, wins_len);
+}
@@ -0,0 +1,37 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <stdio.h>
+#include <xcb/xcb.h>
+
+/* Built-in compositor (COMPOSITOR in config.h).
+ *
+ * Top-level windows are redirected with XComposite and drawn with XRender
+ * onto the composite overlay window, through a back buffer so nothing
+ * flickers. XDamage reports what each window redrew; only the union of
+ * those areas (plus whatever windows uncovered by moving, mapping or
+ * unmapping) is composited again. Everything runs in the X server's
+ * software renderer, so it works the same under Xvfb.
+ */
+
+/* Takes over compositing for the screen. Returns 0 and leaves the screen
+ * alone if Composite, Damage, XFixes or Render is missing or another
+ * compositor owns _NET_WM_CM_S0. Call after atoms_init() and
+ * outputs_init(). */
+int compositor_init(xcb_connection_t *conn, xcb_screen_t *screen);
+
+/* Follows window creation, stacking, geometry, opacity and damage. Feed it
+ * every event; events it has no interest in are ignored. */
+void compositor_handle_event(xcb_connection_t *conn, xcb_generic_event_t *ev);
+
+/* The screen was resized or the root background changed: repaint it all */
+void compositor_screen_changed(xcb_connection_t *conn, xcb_screen_t *screen);
+
+/* Composites what was damaged since the last call. Call once per event
+ * batch. */
+void compositor_paint(xcb_connection_t *conn);
+
+/* Writes paint counters to 'out' */
+void compositor_report(FILE *out);
+
+#endif // COMPOSITOR_H
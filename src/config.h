@@ -6,10 +6,69 @@
 #define BORDER_WIDTH 0
 #define BUTTON_MARGIN 0
 #define CORNER_RADIUS 16
-#define RESIZE_BORDER 0
+#define RESIZE_HANDLE_WIDTH 6 /* Thickness of the edge resize handles */
+#define RESIZE_CORNER_SIZE 20 /* Side of the corner resize handles */
+/* Frame around the sides and bottom of the client; the edge handles fit in
+ * it, so they never cover the client */
+#define RESIZE_BORDER RESIZE_HANDLE_WIDTH
 #define MIN_WIDTH 100
 #define MIN_HEIGHT 50
 
+/* Title bar text */
+#define TITLE_FONT "sans-serif"
+#define TITLE_FONT_SIZE 13
+#define TITLE_PADDING 8
+#define TITLE_BG_COLOR 0xD0D0D0
+#define TITLE_FG_COLOR 0x202020
+
+/* Tiling (layout.h): LAYOUT_FLOATING, LAYOUT_MASTER_STACK or LAYOUT_SPLIT;
+ * ETYWM_LAYOUT=floating|master|split overrides it at startup */
+#define LAYOUT_DEFAULT LAYOUT_FLOATING
+#define LAYOUT_MASTER_RATIO 0.55
+
+/* Virtual workspaces (workspace.h) */
+#define WORKSPACES 4
+
+/* New floating windows that ask for 0,0 go where they cover no other (spatial.h) */
+#define SMART_PLACEMENT 1
+
+/* Helper programs (launcher.h): used when there is no autostart file, one
+ * command per line; "respawn " in front restarts it when it exits, waiting
+ * from RESPAWN_BACKOFF_MIN_MS up to RESPAWN_BACKOFF_MAX_MS if it keeps
+ * exiting within RESPAWN_STABLE_MS */
+#define AUTOSTART "xterm\n"
+#define RESPAWN_BACKOFF_MIN_MS 500
+#define RESPAWN_BACKOFF_MAX_MS 30000
+#define RESPAWN_STABLE_MS 10000
+
+/* Wallpaper, scaled to fill each monitor */
+#define BACKGROUND_IMAGE "/home/serio/etyWM/background_sm.png"
+
+/* Longest gap between two clicks on a title bar that toggles fullscreen */
+#define DOUBLE_CLICK_MS 300
+
+/* Interactive resize pacing: clients supporting _NET_WM_SYNC_REQUEST get a
+ * new size only after acknowledging the previous one (or after the timeout);
+ * other clients are capped to RESIZE_MAX_FPS updates per second */
+#define RESIZE_SYNC 1
+#define RESIZE_SYNC_TIMEOUT_MS 100
+#define RESIZE_MAX_FPS 60
+
+/* Frame recycling: frames of closed windows are kept unmapped for reuse,
+ * up to FRAME_POOL_SIZE; FRAME_POOL_PREWARM are created at startup */
+#define FRAME_POOL_SIZE 16
+#define FRAME_POOL_PREWARM 4
+
+/* Built-in compositor (compositor.c): translucency and damage-bounded
+ * repaint without an external compositor. Set to 0 to leave compositing to
+ * one such as picom; it is also skipped at runtime if one is already
+ * running or the server lacks Composite, Damage, XFixes or Render */
+#define COMPOSITOR 1
+
+/* Log messages above this level are compiled out (0 error, 1 warn, 2 info,
+ * 3 debug); the runtime default is info, see ETYWM_LOG_LEVEL in log.h */
+#define LOG_LEVEL_MAX 3
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
@@ -0,0 +1,530 @@
+#define _GNU_SOURCE /* accept4, struct ucred */
+#include "control.h"
+#include "client.h"
+#include "config.h"
+#include "layout.h"
+#include "loop.h"
+#include "spatial.h"
+#include "stack.h"
+#include "title.h"
+#include "workspace.h"
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+#include "log.h"
+
+/*
+ * Connections are kept open between messages, so automation pays for the
+ * socket once.  Each one has a fixed input buffer; commands are run as soon
+ * as they are complete and a partial one waits for the next read.  Replies
+ * for everything run in one wakeup are collected in 'out' and written
+ * together.  A reader that does not keep up with its replies is dropped
+ * rather than allowed to stall the event loop.
+ */
+
+#define CONTROL_MAX_CONNS 8
+#define CONTROL_BUFFER 4096
+
+typedef struct
+{
+    int fd;          /* -1 if free */
+    int mode_known;  /* First byte seen */
+    int line_mode;
+    size_t len;
+    char in[CONTROL_BUFFER];
+} Connection;
+
+static xcb_connection_t *conn = NULL;
+static xcb_screen_t *screen = NULL;
+static int listen_fd = -1;
+static char socket_path[108];
+static Connection conns[CONTROL_MAX_CONNS];
+
+static char *out = NULL;
+static size_t out_len = 0, out_cap = 0;
+
+static const char *const op_names[CTL_OP_COUNT] = {
+    NULL, "move", "resize", "fullscreen", "close", "raise", "query", "workspace", "layout", "at",
+};
+static const char *const status_names[] = { "ok", "no such window", "not possible now", "bad command" };
+static const char *const layout_names[] = { "floating", "master", "split" };
+
+static unsigned long commands[CTL_OP_COUNT];
+static unsigned long batches = 0;
+static unsigned long batch_max = 0;
+static unsigned long connections = 0;
+static unsigned long refused = 0;
+static unsigned long errors = 0;
+
+static void append(const void *data, size_t len)
+{
+    if (out_len + len > out_cap)
+    {
+        size_t cap = out_cap ? out_cap : CONTROL_BUFFER;
+        while (cap < out_len + len)
+            cap *= 2;
+        char *grown = realloc(out, cap);
+        if (!grown)
+        {
+            log_error("Out of memory replying on the control socket");
+            exit(EXIT_FAILURE);
+        }
+        out = grown;
+        out_cap = cap;
+    }
+    memcpy(out + out_len, data, len);
+    out_len += len;
+}
+
+static void append_line(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void append_line(const char *fmt, ...)
+{
+    char line[1280];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n >= (int)sizeof(line))
+    {
+        n = sizeof(line) - 1;
+        line[n - 1] = '\n';
+    }
+    append(line, n);
+}
+
+static void describe(const Client *c, ControlClient *info)
+{
+    info->client = c->client;
+    info->frame = c->frame;
+    info->x = c->x;
+    info->y = c->y;
+    info->width = c->width;
+    info->height = c->height;
+    info->state = c->state;
+    info->workspace = c->workspace;
+    info->tiled = c->tiled;
+    info->pad = 0;
+}
+
+/* Copies 's' into 'buf' for a quoted field: '"', '\\' and control characters
+ * are escaped, so a title cannot end the field or the line */
+static void escape(const char *s, char *buf, size_t size)
+{
+    size_t n = 0;
+    for (; *s && n + 5 < size; s++)
+    {
+        unsigned char ch = *s;
+        if (ch == '"' || ch == '\\')
+        {
+            buf[n++] = '\\';
+            buf[n++] = ch;
+        }
+        else if (ch < 0x20 || ch == 0x7f)
+        {
+            n += snprintf(buf + n, size - n, "\\x%02x", ch);
+        }
+        else
+        {
+            buf[n++] = ch;
+        }
+    }
+    buf[n] = '\0';
+}
+
+/* Query replies come from the client table; nothing is asked of the server */
+static void query(uint8_t op, const Client *only, int line_mode)
+{
+    int n = only ? 1 : client_count();
+    if (!line_mode)
+    {
+        ControlReply reply = { .op = op, .status = CTL_OK, .count = n };
+        append(&reply, sizeof(reply));
+    }
+    for (int i = 0; i < n; i++)
+    {
+        const Client *c = only ? only : client_at(i);
+        ControlClient info;
+        describe(c, &info);
+        if (line_mode)
+        {
+            char title[1024];
+            escape(c->title_text ? c->title_text : "", title, sizeof(title));
+            append_line("0x%x 0x%x %d %d %d %d %d %d %d \"%s\"\n", info.client, info.frame, info.x, info.y,
+                        info.width, info.height, info.state, info.workspace, info.tiled, title);
+        }
+        else
+        {
+            append(&info, sizeof(info));
+        }
+    }
+}
+
+/* Runs one command; queries append their own reply */
+static int run(const ControlCommand *cmd, int line_mode)
+{
+    if (cmd->op == 0 || cmd->op >= CTL_OP_COUNT)
+        return CTL_BAD_COMMAND;
+    commands[cmd->op]++;
+
+    switch (cmd->op)
+    {
+    case CTL_WORKSPACE:
+        if (cmd->args[0] < 0 || cmd->args[0] >= WORKSPACES)
+            return CTL_BAD_COMMAND;
+        workspace_switch(conn, cmd->args[0]);
+        return CTL_OK;
+    case CTL_LAYOUT:
+        if (cmd->args[0] < LAYOUT_FLOATING || cmd->args[0] > LAYOUT_SPLIT)
+            return CTL_BAD_COMMAND;
+        layout_set_mode(cmd->args[0]);
+        return CTL_OK;
+    case CTL_QUERY:
+        if (cmd->window == XCB_NONE)
+        {
+            query(CTL_QUERY, NULL, line_mode);
+            return -1;
+        }
+        break;
+    case CTL_AT: {
+        /* The same lookup a click would need, from the spatial index */
+        const Client *top = spatial_client_at(cmd->args[0], cmd->args[1]);
+        if (!top)
+            return CTL_NO_WINDOW;
+        query(CTL_AT, top, line_mode);
+        return -1;
+    }
+    }
+
+    Client *c = find_client(cmd->window);
+    if (!c)
+        return CTL_NO_WINDOW;
+
+    switch (cmd->op)
+    {
+    case CTL_MOVE:
+    case CTL_RESIZE:
+        if (c->state == STATE_FULLSCREEN)
+            return CTL_BAD_STATE;
+        /* Placed by hand, like a drag: it floats from now on */
+        layout_remove(c);
+        if (cmd->op == CTL_MOVE)
+            client_configure(conn, c, cmd->args[0], cmd->args[1], c->width, c->height);
+        else
+            client_configure(conn, c, c->x, c->y, cmd->args[0], cmd->args[1]);
+        return CTL_OK;
+    case CTL_FULLSCREEN:
+        toggle_fullscreen(conn, screen, c);
+        return CTL_OK;
+    case CTL_CLOSE:
+        destroy_client(conn, c);
+        return CTL_OK;
+    case CTL_RAISE:
+        stack_raise(c);
+        return CTL_OK;
+    case CTL_QUERY:
+        query(CTL_QUERY, c, line_mode);
+        return -1;
+    }
+    return CTL_BAD_COMMAND;
+}
+
+static void reply(uint8_t op, int status, int line_mode)
+{
+    if (status < 0)
+    {
+        if (line_mode)
+            append_line("ok\n");
+        return;
+    }
+    if (status != CTL_OK)
+        errors++;
+    if (line_mode)
+    {
+        if (status == CTL_OK)
+            append_line("ok\n");
+        else
+            append_line("error %s\n", status_names[status]);
+        return;
+    }
+    ControlReply r = { .op = op, .status = status };
+    append(&r, sizeof(r));
+}
+
+/* Parses a whole decimal or 0x hex number; returns 0 if 'arg' is not one
+ * or it lies outside [min, max] */
+static int parse_number(const char *arg, long min, long max, long *value)
+{
+    char *end;
+    errno = 0;
+    *value = strtol(arg, &end, 0);
+    return end != arg && !*end && !errno && *value >= min && *value <= max;
+}
+
+/* Parses one line into a command; returns 0 if it is malformed */
+static int parse_line(char *line, ControlCommand *cmd)
+{
+    memset(cmd, 0, sizeof(*cmd));
+    char *save = NULL;
+    char *word = strtok_r(line, " \t\r", &save);
+    if (!word)
+        return 0;
+    for (int op = 1; op < CTL_OP_COUNT; op++)
+    {
+        if (!strcmp(word, op_names[op]))
+            cmd->op = op;
+    }
+    if (!cmd->op)
+        return 0;
+
+    char *arg = strtok_r(NULL, " \t\r", &save);
+    if (cmd->op == CTL_LAYOUT)
+    {
+        cmd->args[0] = -1;
+        for (int m = LAYOUT_FLOATING; arg && m <= LAYOUT_SPLIT; m++)
+        {
+            if (!strcmp(arg, layout_names[m]))
+                cmd->args[0] = m;
+        }
+        return cmd->args[0] >= 0;
+    }
+    if (cmd->op == CTL_WORKSPACE)
+    {
+        long n;
+        if (!arg || !parse_number(arg, 0, INT_MAX, &n))
+            return 0;
+        cmd->args[0] = n;
+        return 1;
+    }
+    if (cmd->op == CTL_AT)
+    {
+        for (int i = 0; i < 2; i++, arg = strtok_r(NULL, " \t\r", &save))
+        {
+            long n;
+            if (!arg || !parse_number(arg, INT32_MIN, INT32_MAX, &n))
+                return 0;
+            cmd->args[i] = n;
+        }
+        return 1;
+    }
+    if (!arg)
+        return cmd->op == CTL_QUERY;
+    long window;
+    if (!parse_number(arg, 0, UINT32_MAX, &window))
+        return 0;
+    cmd->window = window;
+    for (int i = 0; i < 2 && (cmd->op == CTL_MOVE || cmd->op == CTL_RESIZE); i++)
+    {
+        long n;
+        arg = strtok_r(NULL, " \t\r", &save);
+        if (!arg || !parse_number(arg, INT32_MIN, INT32_MAX, &n))
+            return 0;
+        cmd->args[i] = n;
+    }
+    return 1;
+}
+
+/* Runs every complete command in the buffer; returns how many */
+static int run_buffered(Connection *k)
+{
+    int ran = 0;
+    size_t used = 0;
+    if (k->line_mode)
+    {
+        char *nl;
+        while ((nl = memchr(k->in + used, '\n', k->len - used)))
+        {
+            *nl = '\0';
+            ControlCommand cmd;
+            char *line = k->in + used;
+            used = nl - k->in + 1;
+            if (!*line || (*line == '\r' && !line[1]))
+                continue;
+            int status = parse_line(line, &cmd) ? run(&cmd, 1) : CTL_BAD_COMMAND;
+            reply(cmd.op, status, 1);
+            ran++;
+        }
+    }
+    else
+    {
+        while (k->len - used >= sizeof(ControlCommand))
+        {
+            ControlCommand cmd;
+            memcpy(&cmd, k->in + used, sizeof(cmd));
+            used += sizeof(cmd);
+            reply(cmd.op, run(&cmd, 0), 0);
+            ran++;
+        }
+    }
+    memmove(k->in, k->in + used, k->len - used);
+    k->len -= used;
+    return ran;
+}
+
+static void drop(Connection *k)
+{
+    loop_remove_fd(k->fd);
+    close(k->fd);
+    k->fd = -1;
+}
+
+static void readable(int fd, uint32_t events, void *data)
+{
+    Connection *k = data;
+    int ran = 0, closed = 0;
+    out_len = 0;
+
+    for (;;)
+    {
+        ssize_t n = read(fd, k->in + k->len, sizeof(k->in) - k->len);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n <= 0)
+        {
+            closed = 1;
+            break;
+        }
+        if (!k->mode_known)
+        {
+            k->mode_known = 1;
+            k->line_mode = isprint((unsigned char)k->in[0]);
+        }
+        k->len += n;
+        ran += run_buffered(k);
+        if (k->len == sizeof(k->in))
+        {
+            log_warn("Control command longer than %d bytes; dropping the connection", CONTROL_BUFFER);
+            closed = 1;
+            break;
+        }
+    }
+
+    if (ran)
+    {
+        batches++;
+        if ((unsigned long)ran > batch_max)
+            batch_max = ran;
+        /* "ok" means done: the layout and stacking work the batch queued is
+         * worked out and everything is sent before the replies go back */
+        layout_update(conn);
+        stack_update(conn);
+        xcb_flush(conn);
+    }
+    if (out_len && send(fd, out, out_len, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)out_len)
+    {
+        log_warn("Control client is not reading its replies; dropping it");
+        closed = 1;
+    }
+    if (closed)
+        drop(k);
+}
+
+static void accept_connections(int fd, uint32_t events, void *data)
+{
+    int client_fd;
+    while ((client_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        /* The directory keeps other users out; this is a second check */
+        struct ucred cred;
+        socklen_t cred_len = sizeof(cred);
+        if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0 || cred.uid != getuid())
+        {
+            log_warn("Refusing a control connection from another user");
+            refused++;
+            close(client_fd);
+            continue;
+        }
+
+        Connection *k = NULL;
+        for (int i = 0; i < CONTROL_MAX_CONNS && !k; i++)
+        {
+            if (conns[i].fd < 0)
+                k = &conns[i];
+        }
+        if (!k || !loop_add_fd(client_fd, EPOLLIN, readable, k))
+        {
+            log_warn("Too many control connections; refusing one");
+            close(client_fd);
+            continue;
+        }
+        k->fd = client_fd;
+        k->mode_known = 0;
+        k->len = 0;
+        connections++;
+    }
+}
+
+int control_init(xcb_connection_t *c, xcb_screen_t *s, const char *dir)
+{
+    conn = c;
+    screen = s;
+    for (int i = 0; i < CONTROL_MAX_CONNS; i++)
+        conns[i].fd = -1;
+    if (!dir)
+        return 0;
+
+    const char *display = getenv("DISPLAY");
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int len = snprintf(socket_path, sizeof(socket_path), "%s/etywm-ctl%s", dir, display ? display : "");
+    if (len >= (int)sizeof(addr.sun_path))
+    {
+        log_warn("Control socket path too long: %s", socket_path);
+        return 0;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+    {
+        log_warn("Could not create control socket: %s", strerror(errno));
+        return 0;
+    }
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 4) < 0 ||
+        !loop_add_fd(listen_fd, EPOLLIN, accept_connections, NULL))
+    {
+        log_warn("Could not listen on control socket %s: %s", socket_path, strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+        return 0;
+    }
+    log_info("Accepting commands on %s", socket_path);
+    return 1;
+}
+
+void control_shutdown(void)
+{
+    for (int i = 0; i < CONTROL_MAX_CONNS; i++)
+    {
+        if (conns[i].fd >= 0)
+            drop(&conns[i]);
+    }
+    if (listen_fd >= 0)
+    {
+        loop_remove_fd(listen_fd);
+        close(listen_fd);
+        unlink(socket_path);
+        listen_fd = -1;
+    }
+    free(out);
+    out = NULL;
+    out_cap = 0;
+}
+
+void control_report(FILE *f)
+{
+    fprintf(f, "etyWM Stats: control %lu connections (%lu refused), %lu batches (largest %lu commands), %lu errors:",
+            connections, refused, batches, batch_max, errors);
+    for (int op = 1; op < CTL_OP_COUNT; op++)
+        fprintf(f, " %lu %s", commands[op], op_names[op]);
+    fprintf(f, "\n");
+}
@@ -0,0 +1,91 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <xcb/xcb.h>
+
+/* Control socket.
+ *
+ * A Unix socket, etywm-ctl$DISPLAY next to the stats socket, accepts a
+ * stream of commands from processes of the same user, served from the
+ * event loop. Everything that arrived
+ * in one read runs as one batch: the requests it causes are flushed together
+ * before the replies go back in one write, so a client that reads "ok" and
+ * then asks the server sees the result. Queries are answered from the
+ * client table without asking the server.
+ *
+ * A connection speaks the binary protocol unless its first byte is
+ * printable, in which case it is line based:
+ *
+ *   move WIN X Y | resize WIN W H | fullscreen WIN | close WIN | raise WIN
+ *   workspace N | layout floating|master|split | query [WIN] | at X Y
+ *
+ * WIN is a client or frame XID (decimal or 0x hex). Every command is
+ * answered with "ok" or "error <reason>". Before that, query prints one
+ * line per client and at one for the topmost window on the current
+ * workspace at that root position: client frame x y width height state
+ * workspace tiled "title",
+ * with '"', '\\' and control characters in the title escaped (\xHH).
+ */
+
+/* Binary commands: fixed-size records in host byte order */
+enum
+{
+    CTL_MOVE = 1,   /* args: x, y */
+    CTL_RESIZE,     /* args: width, height (of the frame) */
+    CTL_FULLSCREEN, /* Toggles */
+    CTL_CLOSE,
+    CTL_RAISE,
+    CTL_QUERY,      /* window XCB_NONE for every client */
+    CTL_WORKSPACE,  /* args: workspace */
+    CTL_LAYOUT,     /* args: LAYOUT_* mode */
+    CTL_AT,         /* args: x, y; answered like a query for the window there */
+    CTL_OP_COUNT
+};
+
+/* Reply status */
+enum
+{
+    CTL_OK = 0,
+    CTL_NO_WINDOW,  /* No managed client by that XID */
+    CTL_BAD_STATE,  /* Not possible now, e.g. moving a fullscreen window */
+    CTL_BAD_COMMAND
+};
+
+typedef struct
+{
+    uint8_t op;
+    uint8_t pad[3];
+    uint32_t window;
+    int32_t args[2];
+} ControlCommand;
+
+/* Sent for every command; a query's is followed by 'count' ControlClient */
+typedef struct
+{
+    uint8_t op;
+    uint8_t status;
+    uint16_t pad;
+    uint32_t count;
+} ControlReply;
+
+typedef struct
+{
+    uint32_t client, frame;
+    int32_t x, y, width, height;
+    uint8_t state, workspace, tiled, pad;
+} ControlClient;
+
+/* Opens the socket in 'dir' and adds it to the event loop. Returns 0 if
+ * 'dir' is NULL or the socket could not be opened; the WM runs on without
+ * it. */
+int control_init(xcb_connection_t *conn, xcb_screen_t *screen, const char *dir);
+
+/* Closes every connection and removes the socket */
+void control_shutdown(void);
+
+/* Writes command counters to 'out' */
+void control_report(FILE *out);
+
+#endif // CONTROL_H
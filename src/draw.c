@@ -1,5 +1,9 @@
 #include "draw.h"
+#include "atoms.h"
 #include "config.h"
+#include "image.h"
+#include "outputs.h"
+#include "resources.h"
 #include <cairo/cairo.h>
 #include <cairo/cairo-xcb.h>
 #include <xcb/xcb.h>
@@ -7,88 +11,238 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "log.h"
 
-void set_rounded_corners(xcb_connection_t *conn, xcb_window_t frame, int width, int height, int radius)
+/*
+ * Rounded-corner shapes are sent as YX-banded rectangles rather than a
+ * rasterized bitmap.  The corner curve only depends on the radius, so it is
+ * computed once as a list of row runs (consecutive rows with the same inset
+ * share a rectangle) and then mirrored and offset for whatever width and
+ * height the frame has.  A frame costs 2 * runs + 1 rectangles and no pixmap,
+ * GC or image upload.
+ */
+typedef struct {
+    int y;      /* First row of the run, from the top edge */
+    int height; /* Number of rows in the run */
+    int inset;  /* Pixels cut from each side on these rows */
+} CornerRun;
+
+static CornerRun *corner_runs = NULL;
+static int corner_nruns = 0;
+static int corner_radius = -1;
+
+static xcb_rectangle_t *shape_rects = NULL;
+static int shape_rects_cap = 0;
+
+/* Builds the run list for 'radius', matching the pixel-center sampling of
+ * the previous Cairo A1 fill. */
+static int build_corner_runs(int radius)
 {
-    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_A1, width, height);
-    cairo_t *cr = cairo_create(surface);
+    if (radius == corner_radius)
+        return 1;
 
-    cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
-    cairo_paint(cr);
-    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
-
-    cairo_set_source_rgb(cr, 1, 1, 1);
-    double r = radius;
-    cairo_move_to(cr, r, 0);
-    cairo_line_to(cr, width - r, 0);
-    cairo_arc(cr, width - r, r, r, -M_PI/2, 0);
-    cairo_line_to(cr, width, height - r);
-    cairo_arc(cr, width - r, height - r, r, 0, M_PI/2);
-    cairo_line_to(cr, r, height);
-    cairo_arc(cr, r, height - r, r, M_PI/2, M_PI);
-    cairo_line_to(cr, 0, r);
-    cairo_arc(cr, r, r, r, M_PI, 3*M_PI/2);
-    cairo_close_path(cr);
-    cairo_fill(cr);
-    cairo_surface_flush(surface);
+    CornerRun *runs = realloc(corner_runs, radius * sizeof(CornerRun));
+    if (!runs && radius > 0)
+        return 0;
+    corner_runs = runs;
+    corner_nruns = 0;
+    for (int y = 0; y < radius; y++) {
+        double dy = radius - (y + 0.5);
+        int inset = (int)ceil(radius - sqrt((double)radius * radius - dy * dy) - 0.5);
+        if (corner_nruns && corner_runs[corner_nruns - 1].inset == inset) {
+            corner_runs[corner_nruns - 1].height++;
+        } else {
+            corner_runs[corner_nruns].y = y;
+            corner_runs[corner_nruns].height = 1;
+            corner_runs[corner_nruns].inset = inset;
+            corner_nruns++;
+        }
+    }
+    corner_radius = radius;
+    return 1;
+}
 
-    xcb_pixmap_t mask_pixmap = xcb_generate_id(conn);
-    xcb_create_pixmap(conn, 1, mask_pixmap, frame, width, height);
+void set_rounded_corners(xcb_connection_t *conn, xcb_window_t frame, int width, int height, int radius)
+{
+    if (radius > width / 2)
+        radius = width / 2;
+    if (radius > height / 2)
+        radius = height / 2;
+    if (radius <= 0) {
+        /* Unshaped: the frame is a plain rectangle */
+        xcb_shape_mask(conn, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_BOUNDING, frame, 0, 0, XCB_NONE);
+        return;
+    }
 
-    xcb_gcontext_t gc = xcb_generate_id(conn);
-    xcb_create_gc(conn, gc, mask_pixmap, 0, NULL);
+    if (!build_corner_runs(radius)) {
+        log_error("Out of memory building corner shape (radius %d)", radius);
+        return;
+    }
 
-    int stride = cairo_image_surface_get_stride(surface);
-    int data_len = stride * height;
-    xcb_put_image(conn, XCB_IMAGE_FORMAT_Z_PIXMAP, mask_pixmap, gc,
-                  width, height, 0, 0, 0, 1,
-                  data_len, (const char *)cairo_image_surface_get_data(surface));
+    int nrects = 2 * corner_nruns + 1;
+    if (nrects > shape_rects_cap) {
+        xcb_rectangle_t *grown = realloc(shape_rects, nrects * sizeof(xcb_rectangle_t));
+        if (!grown) {
+            log_error("Out of memory building corner shape (radius %d)", radius);
+            return;
+        }
+        shape_rects = grown;
+        shape_rects_cap = nrects;
+    }
 
-    xcb_shape_mask(conn, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_BOUNDING, frame, 0, 0, mask_pixmap);
+    xcb_rectangle_t *r = shape_rects;
+    for (int i = 0; i < corner_nruns; i++, r++) {
+        const CornerRun *run = &corner_runs[i];
+        r->x = run->inset;
+        r->y = run->y;
+        r->width = width - 2 * run->inset;
+        r->height = run->height;
+    }
+    r->x = 0;
+    r->y = radius;
+    r->width = width;
+    r->height = height - 2 * radius;
+    r++;
+    for (int i = corner_nruns - 1; i >= 0; i--, r++) {
+        const CornerRun *run = &corner_runs[i];
+        r->x = run->inset;
+        r->y = height - run->y - run->height;
+        r->width = width - 2 * run->inset;
+        r->height = run->height;
+    }
 
-    xcb_free_gc(conn, gc);
-    xcb_free_pixmap(conn, mask_pixmap);
-    cairo_destroy(cr);
-    cairo_surface_destroy(surface);
+    xcb_shape_rectangles(conn, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_BOUNDING,
+                         XCB_CLIP_ORDERING_YX_BANDED, frame, 0, 0, nrects, shape_rects);
 }
 
-xcb_pixmap_t create_background_pixmap(xcb_connection_t *conn, xcb_screen_t *screen, const char *image_path)
+/*
+ * Root background.  The wallpaper is decoded once and scaled separately into
+ * every output's rectangle of one root-sized pixmap.  The pixmap is kept, so
+ * when the outputs change only outputs with a new position or size are
+ * rendered again; when the screen size changes the untouched outputs are
+ * copied across to the new pixmap on the server.
+ */
+static cairo_surface_t *wallpaper = NULL;
+static xcb_pixmap_t bg_pixmap = XCB_NONE;
+static int bg_width = 0, bg_height = 0;
+static Output painted[MAX_OUTPUTS];
+static int painted_len = 0;
+
+static int was_painted(const Output *o)
 {
-    cairo_surface_t *bg_surface = cairo_image_surface_create_from_png(image_path);
-    cairo_status_t status = cairo_surface_status(bg_surface);
-    if (status != CAIRO_STATUS_SUCCESS) {
-        fprintf(stderr, "Error loading PNG: %s\n", cairo_status_to_string(status));
-        return XCB_NONE;
+    for (int i = 0; i < painted_len; i++) {
+        if (painted[i].x == o->x && painted[i].y == o->y &&
+            painted[i].width == o->width && painted[i].height == o->height)
+            return 1;
     }
+    return 0;
+}
 
-    int img_width = cairo_image_surface_get_width(bg_surface);
-    int img_height = cairo_image_surface_get_height(bg_surface);
-    int screen_width = screen->width_in_pixels;
-    int screen_height = screen->height_in_pixels;
-
-    cairo_surface_t *scaled_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, screen_width, screen_height);
-    cairo_t *cr = cairo_create(scaled_surface);
-    double scale_x = (double)screen_width / img_width;
-    double scale_y = (double)screen_height / img_height;
-    cairo_scale(cr, scale_x, scale_y);
-    cairo_set_source_surface(cr, bg_surface, 0, 0);
+/* Scales the wallpaper into the output's rectangle of 'pixmap' */
+static void paint_output(xcb_connection_t *conn, xcb_screen_t *screen, xcb_pixmap_t pixmap,
+                         xcb_gcontext_t gc, const Output *o)
+{
+    /* Render straight into the upload buffer, which is shared with the
+     * server when MIT-SHM is available */
+    ImageBuffer buf;
+    if (!image_buffer_create(conn, &buf, o->width, o->height, 1))
+        return;
+    cairo_surface_t *surface = cairo_image_surface_create_for_data(buf.data, CAIRO_FORMAT_ARGB32,
+                                                                   o->width, o->height, buf.stride);
+    cairo_t *cr = cairo_create(surface);
+    cairo_scale(cr, (double)o->width / cairo_image_surface_get_width(wallpaper),
+                (double)o->height / cairo_image_surface_get_height(wallpaper));
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE); /* The buffer starts uninitialized */
+    cairo_set_source_surface(cr, wallpaper, 0, 0);
     cairo_paint(cr);
     cairo_destroy(cr);
-    cairo_surface_destroy(bg_surface);
+    cairo_surface_flush(surface);
+    cairo_surface_destroy(surface);
+
+    image_buffer_put(conn, &buf, pixmap, gc, screen->root_depth, o->x, o->y);
+    image_buffer_destroy(conn, &buf);
+}
+
+int set_root_background(xcb_connection_t *conn, xcb_screen_t *screen, const char *image_path)
+{
+    if (!wallpaper) {
+        cairo_surface_t *loaded = cairo_image_surface_create_from_png(image_path);
+        cairo_status_t status = cairo_surface_status(loaded);
+        if (status != CAIRO_STATUS_SUCCESS) {
+            log_error("Could not load PNG: %s", cairo_status_to_string(status));
+            cairo_surface_destroy(loaded);
+            return 0;
+        }
+        wallpaper = loaded;
+    }
 
-    xcb_pixmap_t bg_pixmap = xcb_generate_id(conn);
-    xcb_create_pixmap(conn, screen->root_depth, bg_pixmap, screen->root, screen_width, screen_height);
+    int width = screen->width_in_pixels;
+    int height = screen->height_in_pixels;
+    xcb_pixmap_t pixmap = bg_pixmap;
+    xcb_gcontext_t gc = res_new(conn, RES_GC, XCB_NONE);
 
-    xcb_gcontext_t gc = xcb_generate_id(conn);
-    xcb_create_gc(conn, gc, bg_pixmap, 0, NULL);
-    int stride = cairo_image_surface_get_stride(scaled_surface);
-    int data_len = stride * screen_height;
-    xcb_put_image(conn, XCB_IMAGE_FORMAT_Z_PIXMAP, bg_pixmap, gc,
-                  screen_width, screen_height, 0, 0, 0, screen->root_depth,
-                  data_len, (const char *)cairo_image_surface_get_data(scaled_surface));
+    if (pixmap == XCB_NONE || width != bg_width || height != bg_height) {
+        /* New screen size: start from black, then keep what still fits */
+        pixmap = res_new(conn, RES_PIXMAP, XCB_NONE);
+        xcb_create_pixmap(conn, screen->root_depth, pixmap, screen->root, width, height);
+        uint32_t black = screen->black_pixel;
+        xcb_create_gc(conn, gc, pixmap, XCB_GC_FOREGROUND, &black);
+        xcb_rectangle_t all = { 0, 0, width, height };
+        xcb_poly_fill_rectangle(conn, pixmap, gc, 1, &all);
+    } else {
+        xcb_create_gc(conn, gc, pixmap, 0, NULL);
+    }
 
+    int repainted = 0;
+    for (int i = 0; i < output_count(); i++) {
+        const Output *o = output_at(i);
+        if (bg_pixmap != XCB_NONE && was_painted(o)) {
+            if (pixmap != bg_pixmap)
+                xcb_copy_area(conn, bg_pixmap, pixmap, gc, o->x, o->y, o->x, o->y, o->width, o->height);
+            continue;
+        }
+        paint_output(conn, screen, pixmap, gc, o);
+        repainted++;
+    }
     xcb_free_gc(conn, gc);
-    cairo_surface_destroy(scaled_surface);
+    res_free(gc);
+
+    if (pixmap != bg_pixmap) {
+        if (bg_pixmap != XCB_NONE) {
+            xcb_free_pixmap(conn, bg_pixmap);
+            res_free(bg_pixmap);
+        }
+        bg_pixmap = pixmap;
+        bg_width = width;
+        bg_height = height;
+    }
+    painted_len = output_count();
+    for (int i = 0; i < painted_len; i++)
+        painted[i] = *output_at(i);
+
+    /* Set it again even when only its contents changed: the server may have
+     * copied the old contents when it became the background */
+    xcb_change_window_attributes(conn, screen->root, XCB_CW_BACK_PIXMAP, &bg_pixmap);
+    xcb_clear_area(conn, 0, screen->root, 0, 0, width, height);
 
+    /* Set _XROOTPMAP_ID for compositors and ESETROOT_PMAP_ID for some others */
+    if (atoms[ATOM_XROOTPMAP_ID] != XCB_ATOM_NONE) {
+        xcb_change_property(conn, XCB_PROP_MODE_REPLACE, screen->root,
+                            atoms[ATOM_XROOTPMAP_ID], XCB_ATOM_PIXMAP, 32, 1, &bg_pixmap);
+    } else {
+        log_warn("Failed to set _XROOTPMAP_ID property");
+    }
+    if (atoms[ATOM_ESETROOT_PMAP_ID] != XCB_ATOM_NONE) {
+        xcb_change_property(conn, XCB_PROP_MODE_REPLACE, screen->root,
+                            atoms[ATOM_ESETROOT_PMAP_ID], XCB_ATOM_PIXMAP, 32, 1, &bg_pixmap);
+    } else {
+        log_warn("Failed to set ESETROOT_PMAP_ID property");
+    }
+    log_info("Background set (%d of %d outputs rendered)", repainted, output_count());
+    return 1;
+}
+
+xcb_pixmap_t root_background(void)
+{
     return bg_pixmap;
 }
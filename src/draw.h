@@ -3,12 +3,19 @@
 
 #include <xcb/xcb.h>
 
-/* Draws a rounded rectangle mask on the given window.
- * The mask is applied as the shape of the window.
+/* Shapes the given window as a rounded rectangle.
+ * The shape is sent as a handful of rectangles derived from a per-radius
+ * cache; a radius of 0 removes the shape (used for fullscreen frames).
  */
 void set_rounded_corners(xcb_connection_t *conn, xcb_window_t frame, int width, int height, int radius);
 
-/* Loads an image from a PNG file and creates a background pixmap for the root window */
-xcb_pixmap_t create_background_pixmap(xcb_connection_t *conn, xcb_screen_t *screen, const char *image_path);
+/* Makes the PNG the root window background, scaled to fill each output.
+ * Call again after the outputs change; only outputs that moved or resized
+ * are rendered again. Returns 0 if the image cannot be loaded.
+ */
+int set_root_background(xcb_connection_t *conn, xcb_screen_t *screen, const char *image_path);
+
+/* The pixmap set_root_background() last made the background, or XCB_NONE */
+xcb_pixmap_t root_background(void);
 
 #endif // DRAW_H
@@ -0,0 +1,159 @@
+#include "events.h"
+#include <stdlib.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+/*
+ * Event coalescing.
+ *
+ * Each wakeup drains whatever XCB has already read off the socket and folds
+ * redundant events together before anything is dispatched:
+ *
+ *   - MotionNotify: a run of back-to-back motions for the same window and
+ *     button state collapses into the newest.  Any other event in between
+ *     ends the run, so a motion is never dispatched ahead of an event that
+ *     came before it (a button press, an Enter/Leave, a ConfigureNotify).
+ *   - ConfigureRequest: requests for the same window are merged field by
+ *     field (later values win) unless another event about that window
+ *     (map, unmap, destroy, ...) sits in between.
+ *   - Expose: rectangles for the same window are combined into one bounding
+ *     box with count 0.
+ *
+ * Folding happens in place: the earlier event takes the newer values and the
+ * newer event is freed.  That is safe because anything whose relative order
+ * matters (any event for motion, other events about the same window for
+ * ConfigureRequest) stops the fold.
+ */
+
+/* Window an event is "about" for ConfigureRequest barrier purposes. */
+static xcb_window_t subject_window(xcb_generic_event_t *ev)
+{
+    switch (ev->response_type & ~0x80)
+    {
+    case XCB_MAP_REQUEST:
+        return ((xcb_map_request_event_t *)ev)->window;
+    case XCB_MAP_NOTIFY:
+        return ((xcb_map_notify_event_t *)ev)->window;
+    case XCB_UNMAP_NOTIFY:
+        return ((xcb_unmap_notify_event_t *)ev)->window;
+    case XCB_DESTROY_NOTIFY:
+        return ((xcb_destroy_notify_event_t *)ev)->window;
+    case XCB_REPARENT_NOTIFY:
+        return ((xcb_reparent_notify_event_t *)ev)->window;
+    case XCB_CONFIGURE_REQUEST:
+        return ((xcb_configure_request_event_t *)ev)->window;
+    case XCB_CONFIGURE_NOTIFY:
+        return ((xcb_configure_notify_event_t *)ev)->window;
+    default:
+        return XCB_NONE;
+    }
+}
+
+static int coalesce_motion(EventBatch *b, xcb_motion_notify_event_t *m)
+{
+    if (!b->len || (b->ev[b->len - 1]->response_type & ~0x80) != XCB_MOTION_NOTIFY)
+        return 0;
+    xcb_motion_notify_event_t *prev = (xcb_motion_notify_event_t *)b->ev[b->len - 1];
+    if (prev->event != m->event || prev->state != m->state)
+        return 0;
+    *prev = *m;
+    return 1;
+}
+
+static void merge_configure(xcb_configure_request_event_t *dst, const xcb_configure_request_event_t *src)
+{
+    uint16_t m = src->value_mask;
+    if (m & XCB_CONFIG_WINDOW_X)
+        dst->x = src->x;
+    if (m & XCB_CONFIG_WINDOW_Y)
+        dst->y = src->y;
+    if (m & XCB_CONFIG_WINDOW_WIDTH)
+        dst->width = src->width;
+    if (m & XCB_CONFIG_WINDOW_HEIGHT)
+        dst->height = src->height;
+    if (m & XCB_CONFIG_WINDOW_BORDER_WIDTH)
+        dst->border_width = src->border_width;
+    if (m & XCB_CONFIG_WINDOW_SIBLING)
+        dst->sibling = src->sibling;
+    if (m & XCB_CONFIG_WINDOW_STACK_MODE)
+        dst->stack_mode = src->stack_mode;
+    dst->value_mask |= m;
+    dst->sequence = src->sequence;
+}
+
+static int coalesce_configure(EventBatch *b, xcb_configure_request_event_t *cr)
+{
+    for (int k = b->len - 1; k >= 0; k--)
+    {
+        xcb_generic_event_t *ev = b->ev[k];
+        if (subject_window(ev) != cr->window)
+            continue;
+        if ((ev->response_type & ~0x80) != XCB_CONFIGURE_REQUEST)
+            return 0;
+        merge_configure((xcb_configure_request_event_t *)ev, cr);
+        return 1;
+    }
+    return 0;
+}
+
+static int coalesce_expose(EventBatch *b, xcb_expose_event_t *ex)
+{
+    for (int k = b->len - 1; k >= 0; k--)
+    {
+        xcb_expose_event_t *prev = (xcb_expose_event_t *)b->ev[k];
+        if ((prev->response_type & ~0x80) != XCB_EXPOSE || prev->window != ex->window)
+            continue;
+        int x1 = prev->x < ex->x ? prev->x : ex->x;
+        int y1 = prev->y < ex->y ? prev->y : ex->y;
+        int x2 = prev->x + prev->width > ex->x + ex->width ? prev->x + prev->width : ex->x + ex->width;
+        int y2 = prev->y + prev->height > ex->y + ex->height ? prev->y + prev->height : ex->y + ex->height;
+        prev->x = x1;
+        prev->y = y1;
+        prev->width = x2 - x1;
+        prev->height = y2 - y1;
+        prev->count = 0;
+        return 1;
+    }
+    return 0;
+}
+
+int event_batch_fill(xcb_connection_t *conn, EventBatch *batch, xcb_generic_event_t *first)
+{
+    xcb_generic_event_t *ev = first;
+
+    batch->len = 0;
+    batch->merged = 0;
+
+    while (ev)
+    {
+        int folded = 0;
+        switch (ev->response_type & ~0x80)
+        {
+        case XCB_MOTION_NOTIFY:
+            folded = coalesce_motion(batch, (xcb_motion_notify_event_t *)ev);
+            break;
+        case XCB_CONFIGURE_REQUEST:
+            folded = coalesce_configure(batch, (xcb_configure_request_event_t *)ev);
+            break;
+        case XCB_EXPOSE:
+            folded = coalesce_expose(batch, (xcb_expose_event_t *)ev);
+            break;
+        default:
+            break;
+        }
+
+        if (folded)
+        {
+            free(ev);
+            batch->merged++;
+        }
+        else
+        {
+            batch->ev[batch->len++] = ev;
+            if (batch->len == EVENT_BATCH_MAX)
+                break;
+        }
+        ev = xcb_poll_for_queued_event(conn);
+    }
+    return batch->len;
+}
@@ -0,0 +1,21 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <xcb/xcb.h>
+
+#define EVENT_BATCH_MAX 256
+
+/* A batch of events drained from the XCB queue after coalescing */
+typedef struct EventBatch {
+    xcb_generic_event_t *ev[EVENT_BATCH_MAX];
+    int len;
+    int merged; /* Events dropped or merged while filling this batch */
+} EventBatch;
+
+/* Starts a batch with 'first' and drains already-queued events into it
+ * without blocking, coalescing motion, ConfigureRequest and Expose storms.
+ * Returns the number of events left to dispatch (batch->len).
+ */
+int event_batch_fill(xcb_connection_t *conn, EventBatch *batch, xcb_generic_event_t *first);
+
+#endif // EVENTS_H
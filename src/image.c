@@ -0,0 +1,125 @@
+#include "image.h"
+#include "resources.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+#include <xcb/shm.h>
+#include "log.h"
+
+static int shm_attach(xcb_connection_t *conn, ImageBuffer *buf)
+{
+    const xcb_query_extension_reply_t *ext = xcb_get_extension_data(conn, &xcb_shm_id);
+    if (!ext || !ext->present)
+        return 0;
+
+    buf->shmid = shmget(IPC_PRIVATE, buf->size, IPC_CREAT | 0600);
+    if (buf->shmid < 0)
+        return 0;
+    buf->data = shmat(buf->shmid, NULL, 0);
+    if (buf->data == (void *)-1)
+    {
+        shmctl(buf->shmid, IPC_RMID, NULL);
+        buf->data = NULL;
+        return 0;
+    }
+
+    /* A server on another host reports MIT-SHM but cannot attach, so the
+     * attach has to be checked before relying on it */
+    buf->shmseg = res_new(conn, RES_SHMSEG, XCB_NONE);
+    xcb_void_cookie_t cookie = xcb_shm_attach_checked(conn, buf->shmseg, buf->shmid, 1);
+    stats_round_trip();
+    xcb_generic_error_t *error = xcb_request_check(conn, cookie);
+
+    /* Attached or not, the segment is released once the last user detaches */
+    shmctl(buf->shmid, IPC_RMID, NULL);
+    if (error)
+    {
+        free(error);
+        res_free(buf->shmseg);
+        shmdt(buf->data);
+        buf->data = NULL;
+        buf->shmseg = XCB_NONE;
+        return 0;
+    }
+    return 1;
+}
+
+int image_buffer_create(xcb_connection_t *conn, ImageBuffer *buf, int width, int height, int allow_shm)
+{
+    buf->width = width;
+    buf->height = height;
+    buf->stride = width * 4;
+    buf->size = (size_t)buf->stride * height;
+    buf->data = NULL;
+    buf->shmseg = XCB_NONE;
+    buf->shmid = -1;
+
+    if (allow_shm && shm_attach(conn, buf))
+        return 1;
+
+    buf->data = malloc(buf->size);
+    if (!buf->data)
+    {
+        log_error("Out of memory allocating %dx%d image", width, height);
+        return 0;
+    }
+    return 1;
+}
+
+void image_buffer_put(xcb_connection_t *conn, ImageBuffer *buf, xcb_drawable_t drawable,
+                      xcb_gcontext_t gc, uint8_t depth, int dst_x, int dst_y)
+{
+    if (buf->shmseg != XCB_NONE)
+    {
+        xcb_shm_put_image(conn, drawable, gc, buf->width, buf->height,
+                          0, 0, buf->width, buf->height, dst_x, dst_y,
+                          depth, XCB_IMAGE_FORMAT_Z_PIXMAP, 0, buf->shmseg, 0);
+        return;
+    }
+
+    /* Without BIG-REQUESTS a request tops out at 256 KiB, so send as many
+     * whole rows per PutImage as fit */
+    size_t max_bytes = (size_t)xcb_get_maximum_request_length(conn) * 4;
+    size_t header = sizeof(xcb_put_image_request_t);
+    int rows = max_bytes > header ? (int)((max_bytes - header) / buf->stride) : 0;
+    if (rows < 1)
+    {
+        log_error("%d-pixel image rows do not fit in one request", buf->width);
+        return;
+    }
+
+    for (int y = 0; y < buf->height; y += rows)
+    {
+        int n = buf->height - y < rows ? buf->height - y : rows;
+        xcb_put_image(conn, XCB_IMAGE_FORMAT_Z_PIXMAP, drawable, gc,
+                      buf->width, n, dst_x, dst_y + y, 0, depth,
+                      (uint32_t)n * buf->stride, buf->data + (size_t)y * buf->stride);
+    }
+}
+
+void image_buffer_destroy(xcb_connection_t *conn, ImageBuffer *buf)
+{
+    if (!buf->data)
+        return;
+
+    if (buf->shmseg != XCB_NONE)
+    {
+        /* Requests are processed in order, so once this round trip returns
+         * the server has finished every put that read the segment */
+        xcb_shm_detach(conn, buf->shmseg);
+        res_free(buf->shmseg);
+        stats_round_trip();
+        free(xcb_get_input_focus_reply(conn, xcb_get_input_focus(conn), NULL));
+        shmdt(buf->data);
+        buf->shmseg = XCB_NONE;
+    }
+    else
+    {
+        free(buf->data);
+    }
+    buf->data = NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <xcb/xcb.h>
+
+/* A 32 bits-per-pixel ZPixmap image on its way to the X server.
+ *
+ * When the server supports MIT-SHM the pixels live in a shared memory
+ * segment the server reads directly, so callers should render straight into
+ * 'data' (e.g. with cairo_image_surface_create_for_data) to avoid any copy.
+ * Otherwise 'data' is ordinary memory and is sent as PutImage stripes sized
+ * to the maximum request length.
+ */
+typedef struct ImageBuffer {
+    uint8_t *data;
+    int width, height;
+    int stride;         /* Bytes per row; equals Cairo's ARGB32 stride */
+    size_t size;
+    uint32_t shmseg;    /* xcb_shm_seg_t, XCB_NONE when not shared */
+    int shmid;
+} ImageBuffer;
+
+/* Allocates a buffer, shared with the server if 'allow_shm' and the server
+ * accepts the segment. Returns 0 on failure.
+ */
+int image_buffer_create(xcb_connection_t *conn, ImageBuffer *buf, int width, int height, int allow_shm);
+
+/* Uploads the whole buffer to 'drawable' at (dst_x, dst_y) */
+void image_buffer_put(xcb_connection_t *conn, ImageBuffer *buf, xcb_drawable_t drawable,
+                      xcb_gcontext_t gc, uint8_t depth, int dst_x, int dst_y);
+
+/* Frees the buffer once the server is done reading it */
+void image_buffer_destroy(xcb_connection_t *conn, ImageBuffer *buf);
+
+#endif // IMAGE_H
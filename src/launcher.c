@@ -0,0 +1,325 @@
+#define _GNU_SOURCE /* POSIX_SPAWN_SETSID */
+#include "launcher.h"
+#include "config.h"
+#include "loop.h"
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "log.h"
+
+/* Helpers must not share the WM's session, or a hangup or Ctrl-C on the
+ * terminal etyWM was started from takes them down with it */
+#ifndef POSIX_SPAWN_SETSID
+#error "posix_spawn() cannot start a new session here (POSIX_SPAWN_SETSID)"
+#endif
+
+/*
+ * Helpers live in a fixed table for as long as they run, and respawned
+ * ones for as long as the WM does.  Spawn latency is the time
+ * posix_spawnp() takes to return, which with glibc includes the child's
+ * exec (it reports exec failures through the return value).
+ */
+
+#define MAX_HELPERS 32
+#define MAX_ARGS 32
+
+extern char **environ;
+
+typedef struct
+{
+    char *command;      /* NULL if the slot is free */
+    pid_t pid;          /* 0 while not running */
+    int respawn;
+    unsigned backoff_ms;
+    uint64_t started_ns;
+    LoopTimer restart;
+} Helper;
+
+static Helper helpers[MAX_HELPERS];
+
+static unsigned long spawned = 0;
+static unsigned long restarts = 0;
+static unsigned long failed = 0;
+static unsigned long reaped = 0;
+static uint64_t spawn_ns_total = 0;
+static uint64_t spawn_ns_max = 0;
+
+/* Starts the helper's command; returns 0 if it could not be started */
+static int start(Helper *h)
+{
+    char *copy = strdup(h->command);
+    if (!copy)
+    {
+        log_error("Out of memory starting %s", h->command);
+        exit(EXIT_FAILURE);
+    }
+    char *argv[MAX_ARGS + 1];
+    char *expanded[MAX_ARGS] = { NULL };
+    int argc = 0;
+    char *save = NULL;
+    for (char *arg = strtok_r(copy, " \t", &save); arg && argc < MAX_ARGS; arg = strtok_r(NULL, " \t", &save))
+    {
+        /* There is no shell to expand "~" or "~/..." */
+        const char *home = getenv("HOME");
+        if (arg[0] == '~' && (arg[1] == '/' || !arg[1]) && home)
+        {
+            if (asprintf(&expanded[argc], "%s%s", home, arg + 1) < 0)
+            {
+                log_error("Out of memory starting %s", h->command);
+                exit(EXIT_FAILURE);
+            }
+            arg = expanded[argc];
+        }
+        argv[argc++] = arg;
+    }
+    argv[argc] = NULL;
+    if (!argc)
+    {
+        free(copy);
+        return 0;
+    }
+
+    /* The child gets the WM's original signal mask and default dispositions
+     * in a session of its own */
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t all;
+    sigfillset(&all);
+    posix_spawnattr_setsigmask(&attr, loop_child_sigmask());
+    posix_spawnattr_setsigdefault(&attr, &all);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSID);
+
+    uint64_t t0 = loop_now_ns();
+    pid_t pid;
+    int err = posix_spawnp(&pid, argv[0], NULL, &attr, argv, environ);
+    uint64_t ns = loop_now_ns() - t0;
+    posix_spawnattr_destroy(&attr);
+
+    if (err)
+    {
+        failed++;
+        log_error("Could not start %s: %s", argv[0], strerror(err));
+        for (int i = 0; i < argc; i++)
+            free(expanded[i]);
+        free(copy);
+        return 0;
+    }
+    spawned++;
+    spawn_ns_total += ns;
+    if (ns > spawn_ns_max)
+        spawn_ns_max = ns;
+    h->pid = pid;
+    h->started_ns = loop_now_ns();
+    log_info("Started %s (pid %d) in %.0f us", argv[0], pid, ns / 1e3);
+    for (int i = 0; i < argc; i++)
+        free(expanded[i]);
+    free(copy);
+    return 1;
+}
+
+static void release(Helper *h)
+{
+    loop_timer_disarm(&h->restart);
+    free(h->command);
+    memset(h, 0, sizeof(*h));
+}
+
+static void restart_due(void *data)
+{
+    Helper *h = data;
+    restarts++;
+    if (start(h))
+        return;
+    /* Could not even start it; try again later */
+    h->backoff_ms = h->backoff_ms * 2 > RESPAWN_BACKOFF_MAX_MS ? RESPAWN_BACKOFF_MAX_MS : h->backoff_ms * 2;
+    loop_timer_arm(&h->restart, h->backoff_ms, restart_due, h);
+}
+
+static void exited(Helper *h, int status)
+{
+    if (WIFSIGNALED(status))
+        log_info("%s (pid %d) was killed by signal %d", h->command, h->pid, WTERMSIG(status));
+    else
+        log_info("%s (pid %d) exited with status %d", h->command, h->pid, WEXITSTATUS(status));
+    h->pid = 0;
+    if (!h->respawn)
+    {
+        release(h);
+        return;
+    }
+
+    /* A helper that keeps dying straight away is restarted ever more slowly */
+    uint64_t ran_ms = (loop_now_ns() - h->started_ns) / 1000000;
+    if (ran_ms >= RESPAWN_STABLE_MS || !h->backoff_ms)
+        h->backoff_ms = RESPAWN_BACKOFF_MIN_MS;
+    else if (h->backoff_ms * 2 <= RESPAWN_BACKOFF_MAX_MS)
+        h->backoff_ms *= 2;
+    else
+        h->backoff_ms = RESPAWN_BACKOFF_MAX_MS;
+    log_info("Restarting %s in %u ms", h->command, h->backoff_ms);
+    loop_timer_arm(&h->restart, h->backoff_ms, restart_due, h);
+}
+
+/* SIGCHLD: signals coalesce, so collect every child that has exited */
+static void reap(int sig)
+{
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        reaped++;
+        for (int i = 0; i < MAX_HELPERS; i++)
+        {
+            if (helpers[i].command && helpers[i].pid == pid)
+            {
+                exited(&helpers[i], status);
+                break;
+            }
+        }
+    }
+}
+
+void launcher_init(void)
+{
+    loop_add_signal(SIGCHLD, reap);
+}
+
+pid_t launcher_spawn(const char *command, int respawn)
+{
+    Helper *h = NULL;
+    for (int i = 0; i < MAX_HELPERS && !h; i++)
+    {
+        if (!helpers[i].command)
+            h = &helpers[i];
+    }
+    if (!h)
+    {
+        log_error("Too many helpers running to start %s", command);
+        return -1;
+    }
+    h->command = strdup(command);
+    if (!h->command)
+    {
+        log_error("Out of memory starting %s", command);
+        exit(EXIT_FAILURE);
+    }
+    h->respawn = respawn;
+    if (!start(h))
+    {
+        release(h);
+        return -1;
+    }
+    return h->pid;
+}
+
+/* Starts each command in 'list'; the text is modified */
+static void run_list(char *list)
+{
+    char *save = NULL;
+    for (char *line = strtok_r(list, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+    {
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        line += strspn(line, " \t");
+        size_t len = strlen(line);
+        while (len && (line[len - 1] == ' ' || line[len - 1] == '\t' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (!len)
+            continue;
+        int respawn = !strncmp(line, "respawn ", 8);
+        if (respawn)
+            line += 8 + strspn(line + 8, " \t");
+        launcher_spawn(line, respawn);
+    }
+}
+
+/* Reads the whole autostart file; NULL if there is none */
+static char *read_list(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return NULL;
+    size_t len = 0, cap = 1024;
+    char *text = malloc(cap);
+    size_t n;
+    while (text && (n = fread(text + len, 1, cap - len - 1, f)) > 0)
+    {
+        len += n;
+        if (cap - len < 256)
+        {
+            cap *= 2;
+            char *grown = realloc(text, cap);
+            if (!grown)
+                free(text);
+            text = grown;
+        }
+    }
+    fclose(f);
+    if (!text)
+    {
+        log_error("Out of memory reading %s", path);
+        exit(EXIT_FAILURE);
+    }
+    text[len] = '\0';
+    log_info("Autostart list: %s", path);
+    return text;
+}
+
+void launcher_autostart(void)
+{
+    char path[4096];
+    char *text = NULL;
+    const char *env = getenv("ETYWM_AUTOSTART");
+    if (env)
+    {
+        text = read_list(env);
+        if (!text)
+            log_warn("Could not read autostart list %s: %s", env, strerror(errno));
+    }
+    else
+    {
+        const char *config = getenv("XDG_CONFIG_HOME");
+        const char *home = getenv("HOME");
+        if (config && *config)
+            snprintf(path, sizeof(path), "%s/etywm/autostart", config);
+        else
+            snprintf(path, sizeof(path), "%s/.config/etywm/autostart", home ? home : "");
+        text = read_list(path);
+    }
+    if (!text)
+    {
+        text = strdup(AUTOSTART);
+        if (!text)
+        {
+            log_error("Out of memory reading the autostart list");
+            exit(EXIT_FAILURE);
+        }
+    }
+    run_list(text);
+    free(text);
+}
+
+void launcher_shutdown(void)
+{
+    for (int i = 0; i < MAX_HELPERS; i++)
+    {
+        if (helpers[i].command)
+            release(&helpers[i]);
+    }
+}
+
+void launcher_report(FILE *out)
+{
+    int running = 0;
+    for (int i = 0; i < MAX_HELPERS; i++)
+        running += helpers[i].pid != 0;
+    fprintf(out, "etyWM Stats: launcher %lu spawned (%lu restarts, %lu failed), %d running, %lu reaped, "
+                 "spawn latency avg %.1f us, max %.1f us\n",
+            spawned, restarts, failed, running, reaped,
+            spawned ? (double)spawn_ns_total / spawned / 1e3 : 0.0, spawn_ns_max / 1e3);
+}
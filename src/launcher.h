@@ -0,0 +1,45 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/* Helper programs.
+ *
+ * Programs are started with posix_spawnp(), which does not copy the WM's
+ * address space the way fork() does, in a session of their own and with
+ * the signal mask the WM started with. Exited children are reaped from the
+ * event loop on SIGCHLD, so none is left a zombie. A helper started with
+ * 'respawn' set is started again when it exits, after a delay that doubles
+ * (RESPAWN_BACKOFF_MIN_MS up to RESPAWN_BACKOFF_MAX_MS) each time it dies
+ * within RESPAWN_STABLE_MS of starting.
+ *
+ * The autostart list is read from $ETYWM_AUTOSTART, else
+ * $XDG_CONFIG_HOME/etywm/autostart (~/.config/etywm/autostart), else
+ * AUTOSTART in config.h. It holds one command per line; arguments are
+ * separated by blanks (there is no quoting), an argument starting with "~/"
+ * is taken relative to $HOME, '#' starts a comment, and a line beginning
+ * with "respawn " is restarted when it exits:
+ *
+ *   xterm
+ *   respawn picom --config ~/.config/picom.conf
+ */
+
+/* Routes SIGCHLD through the event loop; call after loop_init() */
+void launcher_init(void);
+
+/* Starts every program on the autostart list */
+void launcher_autostart(void);
+
+/* Starts 'command' (split at blanks, looked up in $PATH). Returns its pid,
+ * or -1 if it could not be started. */
+pid_t launcher_spawn(const char *command, int respawn);
+
+/* Forgets every helper and cancels pending restarts; running helpers are
+ * left alone */
+void launcher_shutdown(void);
+
+/* Writes spawn counts and latency to 'out' */
+void launcher_report(FILE *out);
+
+#endif // LAUNCHER_H
@@ -0,0 +1,483 @@
+#include "layout.h"
+#include "config.h"
+#include "outputs.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+#include "log.h"
+
+/*
+ * Layout state, one Area per output on each workspace.  Hidden workspaces
+ * keep their tiles, so switching back needs no relayout.
+ *
+ * LAYOUT_SPLIT keeps a binary tree per area: leaves are windows, inner
+ * tiles split their rectangle in half.  A new window splits the leaf that
+ * was added last (along its longer side), and a removed window's sibling
+ * takes over its parent's rectangle, so either change touches exactly one
+ * subtree.  Rectangles in that subtree are recomputed on the spot (it is
+ * only arithmetic); its leaves are queued in 'dirty_tiles' for
+ * layout_update() to place.
+ *
+ * LAYOUT_MASTER_STACK keeps the windows in an array, master first.  Only
+ * the stack column is recomputed unless the master itself changed or the
+ * area went between one and two windows.
+ */
+
+typedef struct Tile
+{
+    struct Tile *parent;
+    struct Tile *child[2]; /* NULL for a leaf */
+    Client *c;             /* Leaf only */
+    int vertical;          /* child[0] above child[1], else left of it */
+    int x, y, width, height;
+    int dirty;             /* Leaf queued in dirty_tiles */
+} Tile;
+
+typedef struct
+{
+    Tile *root;
+    Tile *last;       /* Leaf the next window splits */
+    Client **stack;
+    int stack_len, stack_cap;
+    int stack_dirty;  /* First stack index to recompute, -1 if none */
+    int x, y, width, height;
+} Area;
+
+static Area areas[WORKSPACES][MAX_OUTPUTS];
+static int mode = LAYOUT_DEFAULT;
+
+static Tile **dirty_tiles = NULL;
+static int dirty_len = 0;
+static int dirty_cap = 0;
+static int pending = 0;
+
+static unsigned long relayouts = 0;
+static unsigned long tiles_computed = 0;
+static unsigned long frames_configured = 0;
+static unsigned long frames_unchanged = 0;
+
+static const char *const mode_names[] = { "floating", "master", "split" };
+
+void layout_init(void)
+{
+    const char *env = getenv("ETYWM_LAYOUT");
+    for (int m = 0; env && m < (int)(sizeof(mode_names) / sizeof(mode_names[0])); m++)
+    {
+        if (!strcasecmp(env, mode_names[m]))
+            mode = m;
+    }
+    for (int w = 0; w < WORKSPACES; w++)
+    {
+        for (int i = 0; i < MAX_OUTPUTS; i++)
+            areas[w][i].stack_dirty = -1;
+    }
+    log_info("Layout: %s", mode_names[mode]);
+}
+
+int layout_mode(void)
+{
+    return mode;
+}
+
+static void *grow(void *array, int *cap, size_t size)
+{
+    int n = *cap ? *cap * 2 : 16;
+    void *grown = realloc(array, n * size);
+    if (!grown)
+    {
+        log_error("Out of memory growing the layout");
+        exit(EXIT_FAILURE);
+    }
+    *cap = n;
+    return grown;
+}
+
+static void mark_dirty(Tile *t)
+{
+    if (!t->dirty)
+    {
+        if (dirty_len == dirty_cap)
+            dirty_tiles = grow(dirty_tiles, &dirty_cap, sizeof(Tile *));
+        dirty_tiles[dirty_len++] = t;
+        t->dirty = 1;
+    }
+    pending = 1;
+}
+
+static void free_tile(Tile *t)
+{
+    if (t->dirty)
+    {
+        for (int i = 0; i < dirty_len; i++)
+        {
+            if (dirty_tiles[i] == t)
+            {
+                dirty_tiles[i] = dirty_tiles[--dirty_len];
+                break;
+            }
+        }
+    }
+    free(t);
+}
+
+static Tile *new_tile(void)
+{
+    Tile *t = calloc(1, sizeof(Tile));
+    if (!t)
+    {
+        log_error("Out of memory allocating a tile");
+        exit(EXIT_FAILURE);
+    }
+    return t;
+}
+
+static void mark_stack(Area *a, int from)
+{
+    if (a->stack_dirty < 0 || from < a->stack_dirty)
+        a->stack_dirty = from;
+    pending = 1;
+}
+
+/* Puts 'with' where 't' hangs in the tree */
+static void replace_tile(Area *a, Tile *t, Tile *with)
+{
+    with->parent = t->parent;
+    if (!t->parent)
+        a->root = with;
+    else if (t->parent->child[0] == t)
+        t->parent->child[0] = with;
+    else
+        t->parent->child[1] = with;
+}
+
+static Tile *newest_leaf(Tile *t)
+{
+    while (t->child[1])
+        t = t->child[1];
+    return t;
+}
+
+/* Recomputes the rectangles below 't' from its own and queues its leaves */
+static void compute_tile(Tile *t)
+{
+    tiles_computed++;
+    if (!t->child[0])
+    {
+        mark_dirty(t);
+        return;
+    }
+
+    Tile *a = t->child[0], *b = t->child[1];
+    a->x = t->x;
+    a->y = t->y;
+    if (t->vertical)
+    {
+        a->width = b->width = t->width;
+        a->height = t->height / 2;
+        b->height = t->height - a->height;
+        b->x = t->x;
+        b->y = t->y + a->height;
+    }
+    else
+    {
+        a->height = b->height = t->height;
+        a->width = t->width / 2;
+        b->width = t->width - a->width;
+        b->x = t->x + a->width;
+        b->y = t->y;
+    }
+    compute_tile(a);
+    compute_tile(b);
+}
+
+static void split_insert(Area *a, Client *c)
+{
+    Tile *leaf = new_tile();
+    leaf->c = c;
+    c->tile = leaf;
+
+    if (!a->root)
+    {
+        a->root = leaf;
+        leaf->x = a->x;
+        leaf->y = a->y;
+        leaf->width = a->width;
+        leaf->height = a->height;
+        compute_tile(leaf);
+    }
+    else
+    {
+        Tile *target = a->last ? a->last : newest_leaf(a->root);
+        Tile *split = new_tile();
+        replace_tile(a, target, split);
+        split->x = target->x;
+        split->y = target->y;
+        split->width = target->width;
+        split->height = target->height;
+        split->vertical = target->height > target->width;
+        split->child[0] = target;
+        split->child[1] = leaf;
+        target->parent = split;
+        leaf->parent = split;
+        compute_tile(split);
+    }
+    a->last = leaf;
+}
+
+static void split_remove(Area *a, Client *c)
+{
+    Tile *leaf = c->tile;
+    Tile *parent = leaf->parent;
+    c->tile = NULL;
+
+    if (!parent)
+    {
+        a->root = NULL;
+        a->last = NULL;
+    }
+    else
+    {
+        /* The sibling grows into the parent's rectangle */
+        Tile *sibling = parent->child[0] == leaf ? parent->child[1] : parent->child[0];
+        replace_tile(a, parent, sibling);
+        sibling->x = parent->x;
+        sibling->y = parent->y;
+        sibling->width = parent->width;
+        sibling->height = parent->height;
+        compute_tile(sibling);
+        if (a->last == leaf)
+            a->last = newest_leaf(sibling);
+        free_tile(parent);
+    }
+    free_tile(leaf);
+}
+
+static void stack_insert(Area *a, Client *c)
+{
+    if (a->stack_len == a->stack_cap)
+        a->stack = grow(a->stack, &a->stack_cap, sizeof(Client *));
+    a->stack[a->stack_len++] = c;
+    /* Every stacked window gets shorter; the master narrows for its first */
+    mark_stack(a, a->stack_len <= 2 ? 0 : 1);
+}
+
+static void stack_remove(Area *a, Client *c)
+{
+    int i = 0;
+    while (i < a->stack_len && a->stack[i] != c)
+        i++;
+    if (i == a->stack_len)
+        return;
+    memmove(&a->stack[i], &a->stack[i + 1], (a->stack_len - i - 1) * sizeof(Client *));
+    a->stack_len--;
+    if (a->stack_len)
+        mark_stack(a, (i == 0 || a->stack_len == 1) ? 0 : 1);
+}
+
+static int area_for(const Client *c)
+{
+    const Output *o = output_for_rect(c->x, c->y, c->width, c->height);
+    for (int i = 0; i < output_count(); i++)
+    {
+        if (output_at(i) == o)
+            return i;
+    }
+    return 0;
+}
+
+void layout_insert(Client *c)
+{
+    if (mode == LAYOUT_FLOATING || c->tiled || c->withdrawn || c->state != STATE_NORMAL)
+        return;
+
+    c->tile_area = area_for(c);
+    Area *a = &areas[c->workspace][c->tile_area];
+    if (!a->root && !a->stack_len)
+    {
+        const Output *o = output_at(c->tile_area);
+        a->x = o->x;
+        a->y = o->y;
+        a->width = o->width;
+        a->height = o->height;
+    }
+    c->tiled = 1;
+    if (mode == LAYOUT_SPLIT)
+        split_insert(a, c);
+    else
+        stack_insert(a, c);
+}
+
+void layout_remove(Client *c)
+{
+    if (!c->tiled)
+        return;
+    Area *a = &areas[c->workspace][c->tile_area];
+    if (c->tile)
+        split_remove(a, c);
+    else
+        stack_remove(a, c);
+    c->tiled = 0;
+}
+
+static void free_tree(Tile *t)
+{
+    if (t->child[0])
+    {
+        free_tree(t->child[0]);
+        free_tree(t->child[1]);
+    }
+    free(t);
+}
+
+/* Drops every area and tiles the chosen clients again from scratch */
+static void retile(int all_normal)
+{
+    int n = client_count();
+    Client **chosen = malloc((n ? n : 1) * sizeof(Client *));
+    if (!chosen)
+    {
+        log_error("Out of memory re-tiling %d windows", n);
+        exit(EXIT_FAILURE);
+    }
+    int len = 0;
+    for (int i = 0; i < n; i++)
+    {
+        Client *c = client_at(i);
+        if (c->tiled || (all_normal && c->state == STATE_NORMAL))
+            chosen[len++] = c;
+        c->tiled = 0;
+        c->tile = NULL;
+    }
+
+    /* Taking windows out one by one would recompute what is dropped anyway */
+    for (int i = 0; i < WORKSPACES * MAX_OUTPUTS; i++)
+    {
+        Area *a = &areas[i / MAX_OUTPUTS][i % MAX_OUTPUTS];
+        if (a->root)
+            free_tree(a->root);
+        a->root = NULL;
+        a->last = NULL;
+        a->stack_len = 0;
+        a->stack_dirty = -1;
+    }
+    dirty_len = 0;
+    for (int i = 0; i < len; i++)
+        layout_insert(chosen[i]);
+    free(chosen);
+}
+
+void layout_set_mode(int new_mode)
+{
+    if (new_mode == mode || new_mode < LAYOUT_FLOATING || new_mode > LAYOUT_SPLIT)
+        return;
+    /* Leaving a mode keeps every window where it is */
+    int was = mode;
+    mode = new_mode;
+    if (mode != LAYOUT_FLOATING)
+        retile(1);
+    else if (was != LAYOUT_FLOATING)
+        retile(0);
+    log_info("Layout: %s", mode_names[mode]);
+}
+
+void layout_outputs_changed(void)
+{
+    retile(0);
+}
+
+/* Moves and resizes the frame, sending nothing when it is already there */
+static void place(xcb_connection_t *conn, Client *c, int x, int y, int width, int height)
+{
+    if (width < MIN_WIDTH)
+        width = MIN_WIDTH;
+    if (height < MIN_HEIGHT)
+        height = MIN_HEIGHT;
+    if (x == c->x && y == c->y && width == c->width && height == c->height)
+    {
+        frames_unchanged++;
+        return;
+    }
+    frames_configured++;
+    client_configure(conn, c, x, y, width, height);
+}
+
+static void compute_stack(xcb_connection_t *conn, Area *a)
+{
+    int n = a->stack_len;
+    int from = a->stack_dirty;
+    a->stack_dirty = -1;
+    if (!n)
+        return;
+    if (n == 1)
+    {
+        tiles_computed++;
+        place(conn, a->stack[0], a->x, a->y, a->width, a->height);
+        return;
+    }
+
+    int master_width = (int)(a->width * LAYOUT_MASTER_RATIO);
+    if (from == 0)
+    {
+        tiles_computed++;
+        place(conn, a->stack[0], a->x, a->y, master_width, a->height);
+    }
+    for (int i = from > 1 ? from : 1; i < n; i++)
+    {
+        int top = a->y + (int)((long)(i - 1) * a->height / (n - 1));
+        int bottom = a->y + (int)((long)i * a->height / (n - 1));
+        tiles_computed++;
+        place(conn, a->stack[i], a->x + master_width, top, a->width - master_width, bottom - top);
+    }
+}
+
+void layout_update(xcb_connection_t *conn)
+{
+    if (!pending)
+        return;
+    pending = 0;
+    relayouts++;
+
+    for (int i = 0; i < dirty_len; i++)
+    {
+        Tile *t = dirty_tiles[i];
+        t->dirty = 0;
+        place(conn, t->c, t->x, t->y, t->width, t->height);
+    }
+    dirty_len = 0;
+
+    for (int i = 0; i < WORKSPACES * MAX_OUTPUTS; i++)
+    {
+        Area *a = &areas[i / MAX_OUTPUTS][i % MAX_OUTPUTS];
+        if (a->stack_dirty >= 0)
+            compute_stack(conn, a);
+    }
+}
+
+int layout_configure_request(xcb_connection_t *conn, Client *c)
+{
+    if (!c->tiled)
+        return 0;
+
+    /* ICCCM 4.1.5: a refused request is answered with a synthetic
+     * ConfigureNotify giving the size the client actually has */
+    xcb_configure_notify_event_t ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.response_type = XCB_CONFIGURE_NOTIFY;
+    ev.event = c->client;
+    ev.window = c->client;
+    ev.above_sibling = XCB_NONE;
+    ev.x = c->x + RESIZE_BORDER;
+    ev.y = c->y + TITLE_BAR_HEIGHT;
+    ev.width = c->width - 2 * RESIZE_BORDER;
+    ev.height = c->height - TITLE_BAR_HEIGHT - RESIZE_BORDER;
+    xcb_send_event(conn, 0, c->client, XCB_EVENT_MASK_STRUCTURE_NOTIFY, (const char *)&ev);
+    return 1;
+}
+
+void layout_report(FILE *out)
+{
+    fprintf(out, "etyWM Stats: layout %s, %lu relayouts, %lu tiles computed, %lu frames configured, %lu unchanged\n",
+            mode_names[mode], relayouts, tiles_computed, frames_configured, frames_unchanged);
+}
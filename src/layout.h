@@ -0,0 +1,53 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stdio.h>
+#include <xcb/xcb.h>
+#include "client.h"
+
+/* Layout modes */
+#define LAYOUT_FLOATING     0 /* Windows stay where they are put */
+#define LAYOUT_MASTER_STACK 1 /* One master column, the rest stacked beside it */
+#define LAYOUT_SPLIT        2 /* Each new window splits the last one in two */
+
+/* Tiling.
+ *
+ * Every output tiles its own windows, separately on each workspace. Mapping or unmapping a window only
+ * marks the part of the layout it affects (the split it was added to or
+ * removed from, or the stack column); layout_update() recomputes just those
+ * parts and configures only the frames whose geometry actually changed.
+ * Handlers never flush, so a relayout of any size leaves in one write.
+ */
+
+/* Picks the mode from ETYWM_LAYOUT ("floating", "master" or "split"),
+ * falling back to LAYOUT_DEFAULT in config.h */
+void layout_init(void);
+
+int layout_mode(void);
+
+/* Switches mode, re-tiling every eligible window */
+void layout_set_mode(int mode);
+
+/* A managed window was mapped, or left fullscreen or a drag: tile it in the
+ * current mode. Fullscreen windows are skipped. */
+void layout_insert(Client *c);
+
+/* Takes a window out of the tiling (unmapped, destroyed, made fullscreen or
+ * dragged loose); a no-op for floating windows */
+void layout_remove(Client *c);
+
+/* Outputs were added, removed or rearranged: re-tile everything */
+void layout_outputs_changed(void);
+
+/* Answers a ConfigureRequest from a tiled client with its current size
+ * instead of granting it. Returns 0 (nothing sent) for floating clients. */
+int layout_configure_request(xcb_connection_t *conn, Client *c);
+
+/* Applies the queued layout changes. Call once per event batch, before
+ * titles_update(). */
+void layout_update(xcb_connection_t *conn);
+
+/* Writes relayout counters to 'out' */
+void layout_report(FILE *out);
+
+#endif // LAYOUT_H
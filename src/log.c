@@ -0,0 +1,212 @@
+#include "log.h"
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+/*
+ * Single-producer/single-consumer ring.  The event loop formats each message
+ * into the next free slot (a bounded vsnprintf, no I/O) and publishes it by
+ * advancing 'head'; the writer thread copies published slots into large
+ * write() calls and advances 'tail'.  The producer only wakes the writer
+ * through a semaphore, which costs no system call while the writer is
+ * already busy draining.
+ */
+
+#define LOG_RING_SLOTS 1024 /* Power of two */
+#define LOG_LINE_MAX 256
+
+typedef struct
+{
+    uint16_t len;
+    char text[LOG_LINE_MAX];
+} LogSlot;
+
+int log_level = LOG_INFO;
+
+static LogSlot ring[LOG_RING_SLOTS];
+static atomic_ulong ring_head = 0;
+static atomic_ulong ring_tail = 0;
+static atomic_ulong dropped = 0;
+
+static sem_t wakeup;
+static pthread_t writer;
+static atomic_int running = 0;
+static atomic_int stopping = 0;
+
+static const char *const level_prefix[] = {
+    [LOG_ERROR] = "Error: ",
+    [LOG_WARN] = "Warning: ",
+    [LOG_INFO] = "Info: ",
+    [LOG_DEBUG] = "Debug: ",
+};
+
+static int format_line(char *buf, size_t size, int level, const char *fmt, va_list ap)
+{
+    int n = snprintf(buf, size, "%s", level_prefix[level]);
+    int m = vsnprintf(buf + n, size - n, fmt, ap);
+    if (m < 0)
+        m = 0;
+    n = (n + m < (int)size - 1) ? n + m : (int)size - 2; /* Truncate long lines */
+    buf[n++] = '\n';
+    return n;
+}
+
+static void write_all(const char *buf, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = write(STDERR_FILENO, buf, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+static void drain(void)
+{
+    static char out[64 * 1024];
+    static unsigned long reported = 0;
+    size_t used = 0;
+
+    unsigned long tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    unsigned long head = atomic_load_explicit(&ring_head, memory_order_acquire);
+    while (tail != head)
+    {
+        const LogSlot *slot = &ring[tail & (LOG_RING_SLOTS - 1)];
+        if (used + slot->len > sizeof(out))
+        {
+            write_all(out, used);
+            used = 0;
+        }
+        memcpy(out + used, slot->text, slot->len);
+        used += slot->len;
+        tail++;
+        atomic_store_explicit(&ring_tail, tail, memory_order_release);
+        if (tail == head)
+            head = atomic_load_explicit(&ring_head, memory_order_acquire);
+    }
+
+    write_all(out, used);
+
+    unsigned long lost = atomic_load_explicit(&dropped, memory_order_relaxed);
+    if (lost != reported)
+    {
+        char note[96];
+        int n = snprintf(note, sizeof(note), "Warning: %lu log messages dropped (ring full)\n",
+                         lost - reported);
+        write_all(note, n);
+        reported = lost;
+    }
+}
+
+static void *writer_main(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        while (sem_wait(&wakeup) < 0 && errno == EINTR)
+            ;
+        drain();
+        if (atomic_load(&stopping))
+            break;
+    }
+    drain();
+    return NULL;
+}
+
+void log_init(void)
+{
+    const char *env = getenv("ETYWM_LOG_LEVEL");
+    if (env)
+    {
+        if (!strcasecmp(env, "error"))
+            log_level = LOG_ERROR;
+        else if (!strcasecmp(env, "warn"))
+            log_level = LOG_WARN;
+        else if (!strcasecmp(env, "info"))
+            log_level = LOG_INFO;
+        else if (!strcasecmp(env, "debug"))
+            log_level = LOG_DEBUG;
+    }
+
+    /* Signals are read from the event loop's signalfd (loop.c), which only
+     * works if no thread takes them, so the writer blocks them all */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int started = sem_init(&wakeup, 0, 0) == 0 && pthread_create(&writer, NULL, writer_main, NULL) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (!started)
+    {
+        fprintf(stderr, "Warning: Could not start log writer; logging synchronously\n");
+        return;
+    }
+    atomic_store(&running, 1);
+
+    /* Error paths exit() directly; make sure their last words get out */
+    atexit(log_shutdown);
+}
+
+void log_shutdown(void)
+{
+    if (!atomic_load(&running))
+        return;
+    atomic_store(&stopping, 1);
+    sem_post(&wakeup);
+    pthread_join(writer, NULL);
+    sem_destroy(&wakeup);
+    atomic_store(&running, 0);
+}
+
+unsigned long log_dropped_count(void)
+{
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
+
+void log_write(int level, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+
+    unsigned long head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    unsigned long tail = atomic_load_explicit(&ring_tail, memory_order_acquire);
+    int full = head - tail == LOG_RING_SLOTS;
+
+    /* Errors are never dropped; if the ring is full they jump the queue */
+    if (!atomic_load_explicit(&running, memory_order_relaxed) || (full && level == LOG_ERROR))
+    {
+        char line[LOG_LINE_MAX];
+        int len = format_line(line, sizeof(line), level, fmt, ap);
+        write_all(line, len);
+        va_end(ap);
+        return;
+    }
+
+    if (full)
+    {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        va_end(ap);
+        return;
+    }
+
+    LogSlot *slot = &ring[head & (LOG_RING_SLOTS - 1)];
+    slot->len = format_line(slot->text, sizeof(slot->text), level, fmt, ap);
+    va_end(ap);
+
+    atomic_store_explicit(&ring_head, head + 1, memory_order_release);
+    sem_post(&wakeup);
+}
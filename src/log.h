@@ -0,0 +1,55 @@
+#ifndef LOG_H
+#define LOG_H
+
+/* Levelled logging.
+ *
+ * Messages go into a lock-free ring buffer and a background thread writes
+ * them to stderr, so a slow log consumer (e.g. stderr piped through tee)
+ * never stalls the event loop; when the ring is full the message is
+ * counted as dropped instead of blocking.
+ *
+ * Levels above LOG_LEVEL_MAX (config.h) compile to nothing. Below that, the
+ * runtime level (ETYWM_LOG_LEVEL=error|warn|info|debug) is checked before
+ * any argument is evaluated.
+ *
+ * Only the event loop thread may log. Before log_init() and after
+ * log_shutdown() messages are written synchronously. Forked children must
+ * not log and must leave with _exit().
+ */
+
+#include "config.h"
+
+#define LOG_ERROR 0
+#define LOG_WARN  1
+#define LOG_INFO  2
+#define LOG_DEBUG 3
+
+#ifndef LOG_LEVEL_MAX
+#define LOG_LEVEL_MAX LOG_DEBUG
+#endif
+
+extern int log_level;
+
+#define log_at(level, ...)                                          \
+    do {                                                            \
+        if ((level) <= LOG_LEVEL_MAX && (level) <= log_level)       \
+            log_write((level), __VA_ARGS__);                        \
+    } while (0)
+
+#define log_error(...) log_at(LOG_ERROR, __VA_ARGS__)
+#define log_warn(...)  log_at(LOG_WARN, __VA_ARGS__)
+#define log_info(...)  log_at(LOG_INFO, __VA_ARGS__)
+#define log_debug(...) log_at(LOG_DEBUG, __VA_ARGS__)
+
+/* Reads ETYWM_LOG_LEVEL and starts the writer thread */
+void log_init(void);
+
+/* Writes out everything still queued and stops the writer thread */
+void log_shutdown(void);
+
+/* Messages dropped because the ring was full */
+unsigned long log_dropped_count(void);
+
+void log_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#endif // LOG_H
@@ -0,0 +1,259 @@
+#include "loop.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "log.h"
+
+/*
+ * Loop internals.
+ *
+ * Sources live in a fixed table and epoll hands back a pointer to theirs;
+ * a removed source is only marked free, so removing one from inside a
+ * handler cannot invalidate events still being dispatched.  Armed timers are
+ * kept in a short unsorted array: there are only ever a handful, and the
+ * timerfd is only reprogrammed when the earliest deadline changes.
+ */
+
+#define MAX_SOURCES 32
+#define MAX_TIMERS 32
+#define MAX_EVENTS 16
+
+typedef struct
+{
+    int fd; /* -1 if free */
+    LoopFdHandler fn;
+    void *data;
+} Source;
+
+static int epoll_fd = -1;
+static int timer_fd = -1;
+static int signal_fd = -1;
+
+static Source sources[MAX_SOURCES];
+
+static LoopTimer *timers[MAX_TIMERS];
+static int timers_len = 0;
+static uint64_t timer_fd_deadline = 0; /* What timer_fd is armed for, 0 if disarmed */
+
+static sigset_t loop_signals;
+static sigset_t original_mask;
+static LoopSignalHandler signal_handlers[NSIG];
+
+static unsigned long wakeups = 0;
+static unsigned long fd_events = 0;
+static unsigned long timers_fired = 0;
+static unsigned long signals_handled = 0;
+
+uint64_t loop_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Points timer_fd at the earliest armed deadline */
+static void reprogram(void)
+{
+    uint64_t earliest = 0;
+    for (int i = 0; i < timers_len; i++)
+    {
+        if (!earliest || timers[i]->deadline < earliest)
+            earliest = timers[i]->deadline;
+    }
+    if (earliest == timer_fd_deadline)
+        return;
+    timer_fd_deadline = earliest;
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = earliest / 1000000000ull;
+    spec.it_value.tv_nsec = earliest % 1000000000ull;
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0)
+        log_error("Could not arm the loop timer: %s", strerror(errno));
+}
+
+static void unlink_timer(LoopTimer *t)
+{
+    for (int i = 0; i < timers_len; i++)
+    {
+        if (timers[i] == t)
+        {
+            timers[i] = timers[--timers_len];
+            break;
+        }
+    }
+    t->armed = 0;
+}
+
+void loop_timer_arm(LoopTimer *t, uint64_t delay_ms, void (*fn)(void *data), void *data)
+{
+    if (!t->armed)
+    {
+        if (timers_len == MAX_TIMERS)
+        {
+            log_error("Too many timers armed");
+            return;
+        }
+        timers[timers_len++] = t;
+        t->armed = 1;
+    }
+    t->deadline = loop_now_ns() + delay_ms * 1000000ull;
+    t->fn = fn;
+    t->data = data;
+    reprogram();
+}
+
+void loop_timer_disarm(LoopTimer *t)
+{
+    if (!t->armed)
+        return;
+    unlink_timer(t);
+    reprogram();
+}
+
+static void timers_expired(int fd, uint32_t events, void *data)
+{
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        log_warn("Could not read the loop timer: %s", strerror(errno));
+    timer_fd_deadline = 0;
+
+    /* A handler may arm or disarm timers, so look for the next due one
+     * afresh each time */
+    uint64_t now = loop_now_ns();
+    for (;;)
+    {
+        LoopTimer *due = NULL;
+        for (int i = 0; i < timers_len && !due; i++)
+        {
+            if (timers[i]->deadline <= now)
+                due = timers[i];
+        }
+        if (!due)
+            break;
+        unlink_timer(due);
+        timers_fired++;
+        due->fn(due->data);
+    }
+    reprogram();
+}
+
+static void signals_pending(int fd, uint32_t events, void *data)
+{
+    struct signalfd_siginfo info;
+    while (read(fd, &info, sizeof(info)) == sizeof(info))
+    {
+        signals_handled++;
+        if (info.ssi_signo < NSIG && signal_handlers[info.ssi_signo])
+            signal_handlers[info.ssi_signo](info.ssi_signo);
+    }
+}
+
+int loop_add_fd(int fd, uint32_t events, LoopFdHandler fn, void *data)
+{
+    Source *s = NULL;
+    for (int i = 0; i < MAX_SOURCES && !s; i++)
+    {
+        if (sources[i].fd < 0)
+            s = &sources[i];
+    }
+    if (!s)
+    {
+        log_error("Too many file descriptors in the event loop");
+        return 0;
+    }
+    struct epoll_event ev = { .events = events, .data.ptr = s };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        log_error("Could not watch fd %d: %s", fd, strerror(errno));
+        return 0;
+    }
+    s->fd = fd;
+    s->fn = fn;
+    s->data = data;
+    return 1;
+}
+
+void loop_remove_fd(int fd)
+{
+    for (int i = 0; i < MAX_SOURCES; i++)
+    {
+        if (sources[i].fd == fd)
+        {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            sources[i].fd = -1;
+            return;
+        }
+    }
+}
+
+int loop_add_signal(int sig, LoopSignalHandler fn)
+{
+    if (sig <= 0 || sig >= NSIG)
+        return 0;
+    sigaddset(&loop_signals, sig);
+    signal_handlers[sig] = fn;
+    sigprocmask(SIG_BLOCK, &loop_signals, NULL);
+    if (signalfd(signal_fd, &loop_signals, SFD_NONBLOCK | SFD_CLOEXEC) < 0)
+    {
+        log_error("Could not route signal %d through the loop: %s", sig, strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+const sigset_t *loop_child_sigmask(void)
+{
+    return &original_mask;
+}
+
+int loop_init(void)
+{
+    for (int i = 0; i < MAX_SOURCES; i++)
+        sources[i].fd = -1;
+    sigemptyset(&loop_signals);
+    sigprocmask(SIG_SETMASK, NULL, &original_mask);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    signal_fd = signalfd(-1, &loop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (epoll_fd < 0 || timer_fd < 0 || signal_fd < 0)
+    {
+        log_error("Could not set up the event loop: %s", strerror(errno));
+        return 0;
+    }
+    return loop_add_fd(timer_fd, EPOLLIN, timers_expired, NULL) &&
+           loop_add_fd(signal_fd, EPOLLIN, signals_pending, NULL);
+}
+
+int loop_wait(void)
+{
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+    if (n < 0)
+        return errno == EINTR;
+    wakeups++;
+
+    for (int i = 0; i < n; i++)
+    {
+        Source *s = events[i].data.ptr;
+        if (s->fd < 0)
+            continue;
+        fd_events++;
+        if (s->fn)
+            s->fn(s->fd, events[i].events, s->data);
+    }
+    return 1;
+}
+
+void loop_report(FILE *out)
+{
+    fprintf(out, "etyWM Stats: loop %lu wakeups, %lu fd events, %lu timers fired, %lu signals, %d timers armed\n",
+            wakeups, fd_events, timers_fired, signals_handled, timers_len);
+}
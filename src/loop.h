@@ -0,0 +1,59 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Event loop.
+ *
+ * One epoll set waits on everything the WM reacts to: the X connection,
+ * other file descriptors (sockets), timers and signals. Timers share a
+ * single timerfd armed for the earliest deadline, and signals are read from
+ * a signalfd, so handlers run in the loop like any other callback and never
+ * in signal context. With no timer armed and nothing to read the loop sleeps
+ * in epoll_wait() without waking up.
+ */
+
+typedef void (*LoopFdHandler)(int fd, uint32_t events, void *data);
+typedef void (*LoopSignalHandler)(int sig);
+
+/* A timer is owned by its user and passed around by pointer; zero
+ * initialization makes a disarmed timer */
+typedef struct LoopTimer
+{
+    uint64_t deadline; /* CLOCK_MONOTONIC, ns */
+    void (*fn)(void *data);
+    void *data;
+    int armed;
+} LoopTimer;
+
+/* Creates the epoll set, timerfd and signalfd. Returns 0 on failure. */
+int loop_init(void);
+
+/* Watches 'fd' for 'events' (EPOLLIN, ...); 'fn' runs from loop_wait() */
+int loop_add_fd(int fd, uint32_t events, LoopFdHandler fn, void *data);
+void loop_remove_fd(int fd);
+
+/* Blocks 'sig' and delivers it through the loop instead */
+int loop_add_signal(int sig, LoopSignalHandler fn);
+
+/* The signal mask from before the loop blocked anything; children must
+ * start with it rather than inherit the signals blocked for the loop */
+const sigset_t *loop_child_sigmask(void);
+
+/* Runs 'fn(data)' from the loop 'delay_ms' from now, replacing any earlier
+ * deadline of the same timer */
+void loop_timer_arm(LoopTimer *t, uint64_t delay_ms, void (*fn)(void *data), void *data);
+void loop_timer_disarm(LoopTimer *t);
+
+uint64_t loop_now_ns(void);
+
+/* Waits until at least one source is ready and runs its handlers. Returns 0
+ * if waiting failed. */
+int loop_wait(void);
+
+/* Writes wakeup counters per source to 'out' */
+void loop_report(FILE *out);
+
+#endif // LOOP_H
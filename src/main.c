@@ -10,15 +10,44 @@
  * Date: 2025-02-05
  */
 
+#include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <string.h>
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
+#include <xcb/xcbext.h>
+#include <xcb/sync.h>
+#include <xcb/randr.h>
+#include <xcb/composite.h>
+#include <xcb/damage.h>
+#include <xcb/render.h>
+#include <xcb/shape.h>
+#include <xcb/xfixes.h>
 #include "config.h"
+#include "atoms.h"
 #include "client.h"
+#include "compositor.h"
+#include "control.h"
 #include "draw.h"
+#include "events.h"
+#include "launcher.h"
+#include "layout.h"
+#include "loop.h"
+#include "stats.h"
+#include "resize_sync.h"
+#include "resources.h"
+#include "spatial.h"
+#include "stack.h"
+#include "outputs.h"
+#include "title.h"
+#include "workspace.h"
+#include "log.h"
 
 /* Global variables for dragging/resizing state */
 static int dragging = 0;
@@ -35,15 +64,95 @@ static int orig_frame_height = 0;
 static int resize_flags = 0;
 static Client *resize_client = NULL;
 
+/* Resize pacing (RESIZE_SYNC in config.h): the newest pointer position is
+ * held back until the client acknowledged the previous size, or until the
+ * frame-rate cap allows another update for clients without sync support */
+static int resize_sync = 0;
+static int resize_awaiting_ack = 0;
+static xcb_timestamp_t resize_last_time = 0;
+static int resize_pending = 0;
+static int resize_pending_x = 0, resize_pending_y = 0;
+static xcb_timestamp_t resize_pending_time = 0;
+static LoopTimer resize_timer; /* Sends the held-back size once allowed */
+
+/* Pointer grab issued by start_drag/start_resize; its reply is collected
+ * without blocking by check_pending_grab() */
+static int grab_pending = 0;
+static xcb_grab_pointer_cookie_t grab_cookie;
+
 /* For double-click detection on the title bar */
 static xcb_timestamp_t last_click_time = 0;
+static xcb_window_t last_click_window = XCB_NONE;
+
+/* Cleared by SIGINT/SIGTERM to leave the event loop */
+static int running = 1;
+
+/**
+ * @brief Requests an active pointer grab on a client's frame.
+ *
+ * The reply is not waited for here; check_pending_grab() collects it once it
+ * has arrived so the drag or resize can start without a round trip.
+ *
+ * @param conn Pointer to the XCB connection.
+ * @param c Pointer to the Client whose frame receives the grabbed events.
+ * @param cursor Cursor shown for the whole grab, or XCB_NONE.
+ */
+static void grab_pointer(xcb_connection_t *conn, Client *c, xcb_cursor_t cursor)
+{
+    if (grab_pending)
+        xcb_discard_reply(conn, grab_cookie.sequence);
+    grab_cookie = xcb_grab_pointer(conn, 1, c->frame,
+                                   XCB_EVENT_MASK_BUTTON_RELEASE | XCB_EVENT_MASK_POINTER_MOTION,
+                                   XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC,
+                                   XCB_WINDOW_NONE, cursor, XCB_CURRENT_TIME);
+    grab_pending = 1;
+}
+
+/**
+ * @brief Collects the pending pointer grab reply if it has arrived.
+ *
+ * Cancels the drag or resize in progress when the grab was refused.
+ *
+ * @param conn Pointer to the XCB connection.
+ */
+static void check_pending_grab(xcb_connection_t *conn)
+{
+    xcb_grab_pointer_reply_t *reply = NULL;
+    xcb_generic_error_t *error = NULL;
+
+    if (!grab_pending)
+        return;
+    if (!xcb_poll_for_reply(conn, grab_cookie.sequence, (void **)&reply, &error))
+        return;
+    grab_pending = 0;
+
+    if (!reply || reply->status != XCB_GRAB_STATUS_SUCCESS) {
+        if (dragging) {
+            log_error("Failed to grab pointer for moving window (frame 0x%x)",
+                    drag_client ? drag_client->frame : 0);
+            dragging = 0;
+            drag_client = NULL;
+        }
+        if (resizing) {
+            log_error("Failed to grab pointer for resizing window (frame 0x%x)",
+                    resize_client ? resize_client->frame : 0);
+            if (resize_client)
+                resize_sync_end(conn, resize_client);
+            resizing = 0;
+            resize_client = NULL;
+        }
+    }
+    free(reply);
+    free(error);
+}
 
 /**
  * @brief Initiates the window dragging process.
  *
  * This function records the starting positions for both the pointer and
- * the window frame, grabs the pointer for receiving motion events, and logs
- * an error if the pointer grab fails.
+ * the window frame (from the client's cached geometry) and requests a
+ * pointer grab for receiving motion events. A refused grab is reported and
+ * undone by check_pending_grab().
  *
  * @param conn Pointer to the XCB connection.
  * @param c Pointer to the Client structure representing the window.
@@ -52,35 +161,21 @@ static xcb_timestamp_t last_click_time = 0;
  */
 void start_drag(xcb_connection_t *conn, Client *c, int pointer_x, int pointer_y)
 {
+    /* A tiled window dragged away floats from here on */
+    layout_remove(c);
+
     dragging = 1;
     drag_client = c;
     drag_start_x = pointer_x;
     drag_start_y = pointer_y;
 
-    /* Get current geometry of the frame */
-    xcb_get_geometry_cookie_t geo_cookie = xcb_get_geometry(conn, c->frame);
-    xcb_get_geometry_reply_t *geo = xcb_get_geometry_reply(conn, geo_cookie, NULL);
-    if (geo) {
-        frame_start_x = geo->x;
-        frame_start_y = geo->y;
-        free(geo);
-    } else {
-        fprintf(stderr, "Error: Failed to get geometry for frame 0x%x\n", c->frame);
-    }
+    /* The frame position is cached on the client */
+    frame_start_x = c->x;
+    frame_start_y = c->y;
 
     /* Grab pointer to capture motion events for dragging */
-    xcb_grab_pointer_cookie_t gp_cookie = xcb_grab_pointer(conn, 1, c->frame,
-                                                           XCB_EVENT_MASK_BUTTON_RELEASE | XCB_EVENT_MASK_POINTER_MOTION,
-                                                           XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC,
-                                                           XCB_WINDOW_NONE, XCB_NONE, XCB_CURRENT_TIME);
-    xcb_grab_pointer_reply_t *gp_reply = xcb_grab_pointer_reply(conn, gp_cookie, NULL);
-    if (!gp_reply || gp_reply->status != XCB_GRAB_STATUS_SUCCESS) {
-        fprintf(stderr, "Error: Failed to grab pointer for moving window (frame 0x%x)\n", c->frame);
-        dragging = 0;
-    } else {
-        fprintf(stderr, "etyWM Log: Pointer grabbed for dragging window (frame 0x%x)\n", c->frame);
-    }
-    free(gp_reply);
+    grab_pointer(conn, c, XCB_NONE);
+    log_debug("Pointer grab requested for dragging window (frame 0x%x)", c->frame);
 }
 
 /**
@@ -95,14 +190,14 @@ void end_drag(xcb_connection_t *conn)
     dragging = 0;
     drag_client = NULL;
     xcb_ungrab_pointer(conn, XCB_CURRENT_TIME);
-    fprintf(stderr, "etyWM Log: Dragging ended and pointer ungrabbed\n");
+    log_debug("Dragging ended and pointer ungrabbed");
 }
 
 /**
  * @brief Initiates the window resizing process.
  *
- * Records the starting positions and geometry for the window and its frame,
- * grabs the pointer for motion events, and logs an error if the pointer grab fails.
+ * Records the starting positions and cached geometry of the frame and requests
+ * a pointer grab for motion events; a refused grab is undone by check_pending_grab().
  *
  * @param conn Pointer to the XCB connection.
  * @param c Pointer to the Client structure representing the window.
@@ -113,58 +208,35 @@ void end_drag(xcb_connection_t *conn)
 void start_resize(xcb_connection_t *conn, Client *c, int pointer_x, int pointer_y, int flags)
 {
     if (c->state == STATE_FULLSCREEN) {
-        fprintf(stderr, "Warning: Attempted to resize fullscreen window (frame 0x%x); ignoring request\n", c->frame);
+        log_warn("Attempted to resize fullscreen window (frame 0x%x); ignoring request", c->frame);
         return;
     }
 
+    layout_remove(c);
     resizing = 1;
     resize_client = c;
     resize_start_x = pointer_x;
     resize_start_y = pointer_y;
     resize_flags = flags;
 
-    /* Get current geometry of the frame */
-    xcb_get_geometry_cookie_t geo_cookie = xcb_get_geometry(conn, c->frame);
-    xcb_get_geometry_reply_t *geo = xcb_get_geometry_reply(conn, geo_cookie, NULL);
-    if (geo) {
-        orig_frame_x = geo->x;
-        orig_frame_y = geo->y;
-        orig_frame_width = geo->width;
-        orig_frame_height = geo->height;
-        free(geo);
-    } else {
-        fprintf(stderr, "Error: Failed to get geometry for resizing frame 0x%x\n", c->frame);
-    }
-
-    /* Grab pointer to capture motion events for resizing */
-    xcb_grab_pointer_cookie_t gp_cookie = xcb_grab_pointer(conn, 1, c->frame,
-                                                           XCB_EVENT_MASK_BUTTON_RELEASE | XCB_EVENT_MASK_POINTER_MOTION,
-                                                           XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC,
-                                                           XCB_WINDOW_NONE, XCB_NONE, XCB_CURRENT_TIME);
-    xcb_grab_pointer_reply_t *gp_reply = xcb_grab_pointer_reply(conn, gp_cookie, NULL);
-    if (!gp_reply || gp_reply->status != XCB_GRAB_STATUS_SUCCESS) {
-        fprintf(stderr, "Error: Failed to grab pointer for resizing window (frame 0x%x)\n", c->frame);
-        resizing = 0;
-    } else {
-        fprintf(stderr, "etyWM Log: Pointer grabbed for resizing window (frame 0x%x)\n", c->frame);
-    }
-    free(gp_reply);
-}
-
-/**
- * @brief Ends the resizing process.
- *
- * Ungrabs the pointer and resets resizing-related variables.
- *
- * @param conn Pointer to the XCB connection.
- */
-void end_resize(xcb_connection_t *conn)
-{
-    resizing = 0;
-    resize_client = NULL;
-    resize_flags = 0;
-    xcb_ungrab_pointer(conn, XCB_CURRENT_TIME);
-    fprintf(stderr, "etyWM Log: Resizing ended and pointer ungrabbed\n");
+    /* The frame geometry is cached on the client */
+    orig_frame_x = c->x;
+    orig_frame_y = c->y;
+    orig_frame_width = c->width;
+    orig_frame_height = c->height;
+
+    /* Grab pointer to capture motion events for resizing; the edge's cursor
+     * stays up even when the pointer leaves the handle */
+    grab_pointer(conn, c, resize_cursor(flags));
+    log_debug("Pointer grab requested for resizing window (frame 0x%x)", c->frame);
+
+    /* Pace updates by the client's own redraws when it supports that */
+    resize_sync = RESIZE_SYNC && resize_sync_supported(conn, c);
+    if (resize_sync)
+        resize_sync_begin(conn, c);
+    resize_awaiting_ack = 0;
+    resize_last_time = 0;
+    resize_pending = 0;
 }
 
 /**
@@ -212,7 +284,13 @@ void update_resize(xcb_connection_t *conn, int pointer_x, int pointer_y)
         new_height = MIN_HEIGHT;
     }
 
-    /* Configure the frame window with the new geometry */
+    /* Configure the frame window with the new geometry; the resize handles
+     * follow it by their win_gravity */
+    resize_client->x = new_x;
+    resize_client->y = new_y;
+    resize_client->width = new_width;
+    resize_client->height = new_height;
+    spatial_update(resize_client);
     uint32_t values[4] = { new_x, new_y, new_width, new_height };
     xcb_configure_window(conn, resize_client->frame,
                          XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
@@ -241,50 +319,424 @@ void update_resize(xcb_connection_t *conn, int pointer_x, int pointer_y)
 
     /* Set rounded corners if desired */
     set_rounded_corners(conn, resize_client->frame, new_width, new_height, CORNER_RADIUS);
-    xcb_flush(conn);
-    fprintf(stderr, "etyWM Log: Window (frame 0x%x) resized to %dx%d at (%d,%d)\n",
+    title_invalidate(resize_client);
+    log_debug("Window (frame 0x%x) resized to %dx%d at (%d,%d)",
             resize_client->frame, new_width, new_height, new_x, new_y);
 }
 
 /**
- * @brief Launches the picom compositor.
+ * @brief Ends the resizing process.
  *
- * Forks the process and starts the compositor with the specified configuration file.
+ * Applies any size still held back by pacing, ungrabs the pointer and resets
+ * resizing-related variables.
+ *
+ * @param conn Pointer to the XCB connection.
  */
-void launch_picom(void)
+void end_resize(xcb_connection_t *conn)
 {
-    pid_t pid = fork();
-    if (pid == 0) {
-        /* Child process: Create a new session and execute picom */
-        setsid();
-        execlp("picom", "picom", "--config", "/home/serio/.config/picom.conf", NULL);
-        fprintf(stderr, "Error: Failed to launch picom\n");
-        exit(1);
-    } else if (pid < 0) {
-        fprintf(stderr, "Error: fork() failed when trying to launch picom\n");
-    } else {
-        fprintf(stderr, "etyWM Log: Launched picom (pid %d)\n", pid);
+    loop_timer_disarm(&resize_timer);
+    if (resize_client) {
+        if (resize_pending) {
+            resize_pending = 0;
+            update_resize(conn, resize_pending_x, resize_pending_y);
+        }
+        resize_sync_end(conn, resize_client);
     }
+    resizing = 0;
+    resize_client = NULL;
+    resize_flags = 0;
+    xcb_ungrab_pointer(conn, XCB_CURRENT_TIME);
+    log_debug("Resizing ended and pointer ungrabbed");
 }
 
 /**
- * @brief Launches the xterm terminal emulator.
+ * @brief Sends the held-back pointer position as the new size.
  *
- * Forks the process and starts xterm.
+ * Clients that support _NET_WM_SYNC_REQUEST are sent a sync request first,
+ * and no further size goes out until they acknowledge it.
+ *
+ * @param conn Pointer to the XCB connection.
  */
-void launch_xterm(void)
+static void flush_resize(xcb_connection_t *conn)
 {
-    pid_t pid = fork();
-    if (pid == 0) {
-        /* Child process: Create a new session and execute xterm */
-        setsid();
-        execl("/usr/bin/xterm", "xterm", NULL);
-        fprintf(stderr, "Error: Failed to launch xterm\n");
-        exit(1);
-    } else if (pid < 0) {
-        fprintf(stderr, "Error: fork() failed when trying to launch xterm\n");
+    loop_timer_disarm(&resize_timer);
+    if (!resize_pending)
+        return;
+    if (resize_sync) {
+        resize_sync_request(conn, resize_client, resize_pending_time);
+        resize_awaiting_ack = 1;
+    }
+    resize_last_time = resize_pending_time;
+    resize_pending = 0;
+    update_resize(conn, resize_pending_x, resize_pending_y);
+}
+
+/* The held-back size is due: the sync timeout passed or the frame-rate cap
+ * allows the next update, and the pointer has not moved since */
+static void resize_timer_fired(void *data)
+{
+    if (resizing && resize_client)
+        flush_resize(data);
+}
+
+/**
+ * @brief Handles pointer motion during a resize.
+ *
+ * Records the position and forwards it only when the client has caught up:
+ * after its sync acknowledgement (or RESIZE_SYNC_TIMEOUT_MS without one), or
+ * at most RESIZE_MAX_FPS times per second for clients without sync support.
+ * A position held back is sent by a timer when that time comes, even if no
+ * further motion arrives.
+ *
+ * @param conn Pointer to the XCB connection.
+ * @param pointer_x The current X coordinate of the pointer.
+ * @param pointer_y The current Y coordinate of the pointer.
+ * @param time Server timestamp of the motion event.
+ */
+void resize_motion(xcb_connection_t *conn, int pointer_x, int pointer_y, xcb_timestamp_t time)
+{
+    resize_pending = 1;
+    resize_pending_x = pointer_x;
+    resize_pending_y = pointer_y;
+    resize_pending_time = time;
+
+    xcb_timestamp_t elapsed = time - resize_last_time;
+    xcb_timestamp_t limit = 0;
+    if (resize_sync) {
+        if (resize_awaiting_ack)
+            limit = RESIZE_SYNC_TIMEOUT_MS;
     } else {
-        fprintf(stderr, "etyWM Log: Launched xterm (pid %d)\n", pid);
+        limit = 1000 / RESIZE_MAX_FPS;
+    }
+    if (elapsed < limit) {
+        if (!resize_timer.armed)
+            loop_timer_arm(&resize_timer, limit - elapsed, resize_timer_fired, conn);
+        return;
+    }
+    flush_resize(conn);
+}
+
+/**
+ * @brief Writes every counter the window manager keeps to the given stream.
+ *
+ * @param out Stream to write to.
+ */
+static void dump_stats(FILE *out)
+{
+    stats_report(out);
+    frame_pool_report(out);
+    client_slab_report(out);
+    title_cache_report(out);
+    layout_report(out);
+    workspace_report(out);
+    spatial_report(out);
+    stack_report(out);
+    loop_report(out);
+    control_report(out);
+    launcher_report(out);
+    compositor_report(out);
+    res_report(out);
+    fprintf(out, "etyWM Stats: %lu log messages dropped\n", log_dropped_count());
+}
+
+/**
+ * @brief Finds the directory for etyWM's sockets.
+ *
+ * That is $XDG_RUNTIME_DIR if it is set. Otherwise it is /tmp/etywm-<uid>,
+ * created mode 0700 and only used if it is a directory (not a link) owned
+ * by this user that nobody else can enter, so other users can neither
+ * plant a socket there nor connect to ours.
+ *
+ * @param dir Buffer receiving the directory.
+ * @param size Size of the buffer.
+ * @return 1 on success, 0 if there is no private directory to use.
+ */
+static int socket_dir(char *dir, size_t size)
+{
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime) {
+        snprintf(dir, size, "%s", runtime);
+        return 1;
+    }
+
+    uid_t uid = getuid();
+    snprintf(dir, size, "/tmp/etywm-%u", (unsigned)uid);
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+        log_warn("Could not create %s: %s", dir, strerror(errno));
+        return 0;
+    }
+    struct stat st;
+    if (lstat(dir, &st) < 0 || !S_ISDIR(st.st_mode) || st.st_uid != uid || (st.st_mode & 077)) {
+        log_warn("Not opening sockets in %s: it is not a private directory of this user", dir);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Opens the stats socket for this display.
+ *
+ * The socket lives in the socket directory as etywm-stats<DISPLAY>; every
+ * connection to it receives one JSON report.
+ *
+ * @param dir Directory from socket_dir().
+ * @param path Buffer receiving the socket path.
+ * @param size Size of the buffer.
+ * @return The listening descriptor, or -1.
+ */
+static int open_stats_socket(const char *dir, char *path, size_t size)
+{
+    const char *display = getenv("DISPLAY");
+    snprintf(path, size, "%s/etywm-stats%s", dir, display ? display : "");
+    return stats_listen(path);
+}
+
+/* SIGUSR1, delivered through the event loop */
+static void request_stats_dump(int sig)
+{
+    dump_stats(stderr);
+}
+
+/* SIGINT/SIGTERM: finish the current batch and shut down cleanly */
+static void request_exit(int sig)
+{
+    log_info("Received signal %d; exiting", sig);
+    running = 0;
+}
+
+static void serve_stats(int fd, uint32_t events, void *data)
+{
+    stats_serve(fd);
+}
+
+/**
+ * @brief Dispatches a single X event to its handler.
+ *
+ * @param conn Pointer to the XCB connection.
+ * @param screen Pointer to the managed screen.
+ * @param event The event to handle; ownership stays with the caller.
+ */
+static void handle_event(xcb_connection_t *conn, xcb_screen_t *screen, xcb_generic_event_t *event)
+{
+    uint8_t response = event->response_type & ~0x80;
+    switch (response) {
+        case XCB_MAP_REQUEST: {
+            xcb_map_request_event_t *map_req = (xcb_map_request_event_t *)event;
+            log_info("MAP_REQUEST for window 0x%x", map_req->window);
+            create_frame(conn, screen, map_req->window);
+            break;
+        }
+        case XCB_UNMAP_NOTIFY: {
+            xcb_unmap_notify_event_t *unmap = (xcb_unmap_notify_event_t *)event;
+            Client *c = find_client(unmap->window);
+            /* Frames unmapped by us (workspace switches included) report
+             * here too; only the client's own unmaps matter */
+            if (c && unmap->window == c->client && c->ignore_unmaps > 0) {
+                c->ignore_unmaps--;
+            } else if (c && unmap->window == c->client) {
+                log_info("UNMAP_NOTIFY for client window 0x%x; unmapping frame 0x%x", c->client, c->frame);
+                xcb_unmap_window(conn, c->frame);
+                layout_remove(c);
+                c->withdrawn = 1;
+            }
+            break;
+        }
+        case XCB_MAP_NOTIFY: {
+            /* A client that unmapped itself maps again inside its frame */
+            xcb_map_notify_event_t *mn = (xcb_map_notify_event_t *)event;
+            Client *c = find_client(mn->window);
+            if (c && mn->window == c->client && c->withdrawn) {
+                c->withdrawn = 0;
+                if (c->workspace == workspace_current())
+                    xcb_map_window(conn, c->frame);
+                layout_insert(c);
+            }
+            break;
+        }
+        case XCB_CLIENT_MESSAGE:
+            if (!workspace_client_message(conn, (xcb_client_message_event_t *)event))
+                stack_client_message((xcb_client_message_event_t *)event);
+            break;
+        case XCB_CREATE_NOTIFY: {
+            xcb_create_notify_event_t *cn = (xcb_create_notify_event_t *)event;
+            if (cn->parent == screen->root && !cn->override_redirect && !find_client(cn->window))
+                note_toplevel_geometry(cn->window, cn->x, cn->y, cn->width, cn->height);
+            break;
+        }
+        case XCB_CONFIGURE_NOTIFY: {
+            /* Frames are only configured by etyWM, which updates their
+             * cached geometry as it sends the request; a notify for an
+             * earlier request would put a stale geometry back, e.g. in the
+             * middle of a drag. Other top-level windows are tracked for
+             * placing them when they map. */
+            xcb_configure_notify_event_t *cfg = (xcb_configure_notify_event_t *)event;
+            Client *c = find_client(cfg->window);
+            if (!c && !cfg->override_redirect) {
+                note_toplevel_geometry(cfg->window, cfg->x, cfg->y, cfg->width, cfg->height);
+            }
+            break;
+        }
+        case XCB_CONFIGURE_REQUEST: {
+            xcb_configure_request_event_t *cfg_req = (xcb_configure_request_event_t *)event;
+            Client *c = find_client(cfg_req->window);
+            if (c && cfg_req->window == c->client && layout_configure_request(conn, c)) {
+                /* Tiled: the layout decides the size */
+            } else if (c && cfg_req->window == c->client) {
+                uint32_t values[7];
+                int i = 0;
+                if (cfg_req->value_mask & XCB_CONFIG_WINDOW_WIDTH) {
+                    values[i++] = cfg_req->width;
+                    uint32_t frame_width = cfg_req->width + 2 * RESIZE_BORDER;
+                    c->width = frame_width;
+                    spatial_update(c);
+                    xcb_configure_window(conn, c->frame, XCB_CONFIG_WINDOW_WIDTH, &frame_width);
+                    uint32_t title_width = cfg_req->width;
+                    xcb_configure_window(conn, c->title, XCB_CONFIG_WINDOW_WIDTH, &title_width);
+                    title_invalidate(c);
+                }
+                if (cfg_req->value_mask & XCB_CONFIG_WINDOW_HEIGHT) {
+                    values[i++] = cfg_req->height;
+                    uint32_t frame_height = cfg_req->height + TITLE_BAR_HEIGHT + RESIZE_BORDER;
+                    c->height = frame_height;
+                    spatial_update(c);
+                    xcb_configure_window(conn, c->frame, XCB_CONFIG_WINDOW_HEIGHT, &frame_height);
+                }
+                if (i)
+                    xcb_configure_window(conn, cfg_req->window, cfg_req->value_mask, values);
+            } else {
+                /* For non-managed windows, simply forward the configure request */
+                uint32_t values[7];
+                int i = 0;
+                if (cfg_req->value_mask & XCB_CONFIG_WINDOW_X)
+                    values[i++] = cfg_req->x;
+                if (cfg_req->value_mask & XCB_CONFIG_WINDOW_Y)
+                    values[i++] = cfg_req->y;
+                if (cfg_req->value_mask & XCB_CONFIG_WINDOW_WIDTH)
+                    values[i++] = cfg_req->width;
+                if (cfg_req->value_mask & XCB_CONFIG_WINDOW_HEIGHT)
+                    values[i++] = cfg_req->height;
+                if (cfg_req->value_mask & XCB_CONFIG_WINDOW_BORDER_WIDTH)
+                    values[i++] = cfg_req->border_width;
+                if (cfg_req->value_mask & XCB_CONFIG_WINDOW_SIBLING)
+                    values[i++] = cfg_req->sibling;
+                if (cfg_req->value_mask & XCB_CONFIG_WINDOW_STACK_MODE)
+                    values[i++] = cfg_req->stack_mode;
+                xcb_configure_window(conn, cfg_req->window, cfg_req->value_mask, values);
+            }
+            break;
+        }
+        case XCB_BUTTON_PRESS: {
+            xcb_button_press_event_t *bp = (xcb_button_press_event_t *)event;
+            Client *c = find_client(bp->event);
+            if (!c)
+                c = find_client(bp->child);
+            if (c) {
+                /* Raise the window; nothing is sent if it is on top already */
+                stack_raise(c);
+
+                /* Right-click closes the window */
+                if (bp->detail == 3) {
+                    log_info("Right-click detected; destroying client (frame 0x%x)", c->frame);
+                    destroy_client(conn, c);
+                } else if (bp->detail == 1) {
+                    if (bp->event == c->title) {
+                        /* Check for double-click on the title bar for toggling fullscreen */
+                        if (bp->event == last_click_window && bp->time - last_click_time < DOUBLE_CLICK_MS) {
+                            log_debug("Double-click detected on title bar; toggling fullscreen (frame 0x%x)", c->frame);
+                            toggle_fullscreen(conn, screen, c);
+                            last_click_window = XCB_NONE;
+                        } else {
+                            last_click_time = bp->time;
+                            last_click_window = bp->event;
+                            log_debug("Single-click detected on title bar; starting drag (frame 0x%x)", c->frame);
+                            start_drag(conn, c, bp->root_x, bp->root_y);
+                        }
+                    } else {
+                        /* A press on a resize handle reaches the frame with
+                         * the handle as its child; the server did the hit test */
+                        int flags = client_handle_edges(c, bp->child);
+                        if (flags) {
+                            log_debug("Starting resize (frame 0x%x) with flags 0x%x", c->frame, flags);
+                            start_resize(conn, c, bp->root_x, bp->root_y, flags);
+                        }
+                    }
+                }
+            }
+            break;
+        }
+        case XCB_MOTION_NOTIFY: {
+            xcb_motion_notify_event_t *motion = (xcb_motion_notify_event_t *)event;
+            if (dragging && drag_client) {
+                int dx = motion->root_x - drag_start_x;
+                int dy = motion->root_y - drag_start_y;
+                int new_x = frame_start_x + dx;
+                int new_y = frame_start_y + dy;
+                uint32_t values[2] = { new_x, new_y };
+                drag_client->x = new_x;
+                drag_client->y = new_y;
+                spatial_update(drag_client);
+                xcb_configure_window(conn, drag_client->frame,
+                                     XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, values);
+            } else if (resizing && resize_client) {
+                resize_motion(conn, motion->root_x, motion->root_y, motion->time);
+            }
+            break;
+        }
+        case XCB_BUTTON_RELEASE: {
+            if (dragging) {
+                end_drag(conn);
+            }
+            if (resizing) {
+                end_resize(conn);
+            }
+            break;
+        }
+        case XCB_EXPOSE: {
+            xcb_expose_event_t *ex = (xcb_expose_event_t *)event;
+            Client *c = find_client(ex->window);
+            if (c && ex->window == c->title)
+                title_expose(c, ex->x, ex->y, ex->width, ex->height);
+            break;
+        }
+        case XCB_PROPERTY_NOTIFY: {
+            xcb_property_notify_event_t *pn = (xcb_property_notify_event_t *)event;
+            Client *c = find_client(pn->window);
+            if (c && pn->window == c->client)
+                title_property_notify(c, pn->atom);
+            break;
+        }
+        case XCB_DESTROY_NOTIFY: {
+            xcb_destroy_notify_event_t *dn = (xcb_destroy_notify_event_t *)event;
+            Client *c = find_client(dn->window);
+            if (!c)
+                forget_toplevel_geometry(dn->window);
+            if (c && dn->window == c->client) {
+                log_info("DESTROY_NOTIFY for client window 0x%x; releasing frame 0x%x", c->client, c->frame);
+                layout_remove(c);
+                spatial_remove(c);
+                stack_remove(c);
+                title_forget(c);
+                frame_pool_release(conn, c);
+                resize_sync_forget(conn, c);
+                remove_client_by_frame(c->frame);
+            }
+            /* Whatever the window still owned is a leak from here on */
+            res_window_destroyed(dn->window);
+            break;
+        }
+        default:
+            /* The resized client finished drawing the last size we sent */
+            if (resizing && resize_client && resize_sync_is_ack(resize_client, event)) {
+                resize_awaiting_ack = 0;
+                flush_resize(conn);
+            } else if (outputs_handle_event(conn, screen, event)) {
+                /* Monitors were added, removed or rearranged */
+                set_root_background(conn, screen, BACKGROUND_IMAGE);
+                compositor_screen_changed(conn, screen);
+                spatial_init(screen->width_in_pixels, screen->height_in_pixels);
+                layout_outputs_changed();
+            }
+            break;
     }
 }
 
@@ -298,13 +750,19 @@ void launch_xterm(void)
  */
 int main(void)
 {
+    log_init();
+    if (!loop_init())
+        exit(EXIT_FAILURE);
+    launcher_init();
+
     /* Connect to the X server using XCB */
     xcb_connection_t *conn = xcb_connect(NULL, NULL);
     if (xcb_connection_has_error(conn)) {
-        fprintf(stderr, "Error: Cannot open display\n");
+        log_error("Cannot open display");
         exit(EXIT_FAILURE);
     }
-    fprintf(stderr, "etyWM Log: Connected to X server\n");
+    log_info("Connected to X server");
+    stats_init(conn);
 
     const xcb_setup_t *setup = xcb_get_setup(conn);
     xcb_screen_iterator_t iter = xcb_setup_roots_iterator(setup);
@@ -314,216 +772,116 @@ int main(void)
     uint32_t mask = XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY;
     xcb_void_cookie_t cookie = xcb_change_window_attributes_checked(conn, screen->root,
                                                                     XCB_CW_EVENT_MASK, &mask);
+    stats_round_trip();
     if (xcb_request_check(conn, cookie)) {
-        fprintf(stderr, "Error: Another window manager is already running.\n");
+        log_error("Another window manager is already running.");
         xcb_disconnect(conn);
         exit(EXIT_FAILURE);
     }
-    xcb_flush(conn);
-    fprintf(stderr, "etyWM Log: Substructure events selected on root window\n");
-
-    /* Launch external helper programs */
-   // launch_picom();
-    launch_xterm();
-
-    /* Create and set a background pixmap */
-    xcb_pixmap_t bg_pixmap = create_background_pixmap(conn, screen, "/home/serio/etyWM/background_sm.png");
-    if (bg_pixmap != XCB_NONE) {
-        uint32_t value = bg_pixmap;
-        xcb_change_window_attributes(conn, screen->root, XCB_CW_BACK_PIXMAP, &value);
-        xcb_clear_area(conn, 0, screen->root, 0, 0,
-                       screen->width_in_pixels, screen->height_in_pixels);
-
-        /* Set _XROOTPMAP_ID for compositors */
-        xcb_intern_atom_cookie_t cookie1 = xcb_intern_atom(conn, 0, strlen("_XROOTPMAP_ID"), "_XROOTPMAP_ID");
-        xcb_intern_atom_reply_t *reply1 = xcb_intern_atom_reply(conn, cookie1, NULL);
-        if (reply1) {
-            xcb_change_property(conn, XCB_PROP_MODE_REPLACE, screen->root,
-                                reply1->atom, XCB_ATOM_PIXMAP, 32, 1,
-                                (unsigned char *)&bg_pixmap);
-            free(reply1);
-        } else {
-            fprintf(stderr, "Warning: Failed to set _XROOTPMAP_ID property\n");
-        }
-
-        /* Set ESETROOT_PMAP_ID for some compositors */
-        xcb_intern_atom_cookie_t cookie2 = xcb_intern_atom(conn, 0, strlen("ESETROOT_PMAP_ID"), "ESETROOT_PMAP_ID");
-        xcb_intern_atom_reply_t *reply2 = xcb_intern_atom_reply(conn, cookie2, NULL);
-        if (reply2) {
-            xcb_change_property(conn, XCB_PROP_MODE_REPLACE, screen->root,
-                                reply2->atom, XCB_ATOM_PIXMAP, 32, 1,
-                                (unsigned char *)&bg_pixmap);
-            free(reply2);
-        } else {
-            fprintf(stderr, "Warning: Failed to set ESETROOT_PMAP_ID property\n");
-        }
-        fprintf(stderr, "etyWM Log: Background pixmap set successfully\n");
-    } else {
-        fprintf(stderr, "Error: Failed to create background pixmap\n");
+    log_info("Substructure events selected on root window");
+
+    /* Intern every atom we use in one batch; the extension queries ride along */
+    xcb_prefetch_extension_data(conn, &xcb_sync_id);
+    xcb_prefetch_extension_data(conn, &xcb_randr_id);
+    if (COMPOSITOR) {
+        xcb_prefetch_extension_data(conn, &xcb_composite_id);
+        xcb_prefetch_extension_data(conn, &xcb_damage_id);
+        xcb_prefetch_extension_data(conn, &xcb_xfixes_id);
+        xcb_prefetch_extension_data(conn, &xcb_render_id);
+        xcb_prefetch_extension_data(conn, &xcb_shape_id);
     }
-    xcb_flush(conn);
-
-    /* Main event loop */
-    xcb_generic_event_t *event;
-    while ((event = xcb_wait_for_event(conn))) {
-        uint8_t response = event->response_type & ~0x80;
-        switch (response) {
-            case XCB_MAP_REQUEST: {
-                xcb_map_request_event_t *map_req = (xcb_map_request_event_t *)event;
-                fprintf(stderr, "etyWM Log: MAP_REQUEST for window 0x%x\n", map_req->window);
-                create_frame(conn, screen, map_req->window);
-                break;
-            }
-            case XCB_UNMAP_NOTIFY: {
-                xcb_unmap_notify_event_t *unmap = (xcb_unmap_notify_event_t *)event;
-                Client *c = find_client(unmap->window);
-                if (c && unmap->window == c->client) {
-                    fprintf(stderr, "etyWM Log: UNMAP_NOTIFY for client window 0x%x; unmapping frame 0x%x\n", c->client, c->frame);
-                    xcb_unmap_window(conn, c->frame);
-                    xcb_flush(conn);
-                }
-                break;
-            }
-            case XCB_CONFIGURE_REQUEST: {
-                xcb_configure_request_event_t *cfg_req = (xcb_configure_request_event_t *)event;
-                Client *c = find_client(cfg_req->window);
-                if (c && cfg_req->window == c->client) {
-                    uint32_t values[7];
-                    int i = 0;
-                    if (cfg_req->value_mask & XCB_CONFIG_WINDOW_WIDTH) {
-                        values[i++] = cfg_req->width;
-                        uint32_t frame_width = cfg_req->width + 2 * RESIZE_BORDER;
-                        xcb_configure_window(conn, c->frame, XCB_CONFIG_WINDOW_WIDTH, &frame_width);
-                    }
-                    if (cfg_req->value_mask & XCB_CONFIG_WINDOW_HEIGHT) {
-                        values[i++] = cfg_req->height;
-                        uint32_t frame_height = cfg_req->height + TITLE_BAR_HEIGHT + RESIZE_BORDER;
-                        xcb_configure_window(conn, c->frame, XCB_CONFIG_WINDOW_HEIGHT, &frame_height);
-                    }
-                    if (i)
-                        xcb_configure_window(conn, cfg_req->window, cfg_req->value_mask, values);
-                } else {
-                    /* For non-managed windows, simply forward the configure request */
-                    uint32_t values[7];
-                    int i = 0;
-                    if (cfg_req->value_mask & XCB_CONFIG_WINDOW_X)
-                        values[i++] = cfg_req->x;
-                    if (cfg_req->value_mask & XCB_CONFIG_WINDOW_Y)
-                        values[i++] = cfg_req->y;
-                    if (cfg_req->value_mask & XCB_CONFIG_WINDOW_WIDTH)
-                        values[i++] = cfg_req->width;
-                    if (cfg_req->value_mask & XCB_CONFIG_WINDOW_HEIGHT)
-                        values[i++] = cfg_req->height;
-                    if (cfg_req->value_mask & XCB_CONFIG_WINDOW_BORDER_WIDTH)
-                        values[i++] = cfg_req->border_width;
-                    if (cfg_req->value_mask & XCB_CONFIG_WINDOW_SIBLING)
-                        values[i++] = cfg_req->sibling;
-                    if (cfg_req->value_mask & XCB_CONFIG_WINDOW_STACK_MODE)
-                        values[i++] = cfg_req->stack_mode;
-                    xcb_configure_window(conn, cfg_req->window, cfg_req->value_mask, values);
-                }
-                xcb_flush(conn);
-                break;
-            }
-            case XCB_BUTTON_PRESS: {
-                xcb_button_press_event_t *bp = (xcb_button_press_event_t *)event;
-                Client *c = find_client(bp->event);
-                if (!c)
-                    c = find_client(bp->child);
-                if (c) {
-                    /* Raise the window */
-                    uint32_t values[] = { XCB_STACK_MODE_ABOVE };
-                    xcb_configure_window(conn, c->frame, XCB_CONFIG_WINDOW_STACK_MODE, values);
-
-                    /* Right-click closes the window */
-                    if (bp->detail == 3) {
-                        fprintf(stderr, "etyWM Log: Right-click detected; destroying client (frame 0x%x)\n", c->frame);
-                        destroy_client(conn, c);
-                    } else if (bp->detail == 1) {
-                        if (bp->event == c->title) {
-                            /* Check for double-click on the title bar for toggling fullscreen */
-                            if (bp->time - last_click_time < 300) {
-                                fprintf(stderr, "etyWM Log: Double-click detected on title bar; toggling fullscreen (frame 0x%x)\n", c->frame);
-                                toggle_fullscreen(conn, screen, c);
-                                last_click_time = 0;
-                            } else {
-                                last_click_time = bp->time;
-                                fprintf(stderr, "etyWM Log: Single-click detected on title bar; starting drag (frame 0x%x)\n", c->frame);
-                                start_drag(conn, c, bp->root_x, bp->root_y);
-                            }
-                        } else {
-                            /* Determine if a resize should be started based on pointer location */
-                            int rel_x = bp->event_x;
-                            int rel_y = bp->event_y;
-                            xcb_get_geometry_cookie_t geo_cookie = xcb_get_geometry(conn, c->frame);
-                            xcb_get_geometry_reply_t *geo = xcb_get_geometry_reply(conn, geo_cookie, NULL);
-                            if (!geo) {
-                                fprintf(stderr, "Error: Failed to get geometry during button press (frame 0x%x)\n", c->frame);
-                                break;
-                            }
-                            int fw = geo->width, fh = geo->height;
-                            free(geo);
-                            int flags = 0;
-                            if (rel_x < RESIZE_BORDER)
-                                flags |= RESIZE_LEFT;
-                            if (rel_x > (fw - RESIZE_BORDER))
-                                flags |= RESIZE_RIGHT;
-                            if (rel_y < RESIZE_BORDER)
-                                flags |= RESIZE_TOP;
-                            if (rel_y > (fh - RESIZE_BORDER))
-                                flags |= RESIZE_BOTTOM;
-                            if (flags) {
-                                fprintf(stderr, "etyWM Log: Starting resize (frame 0x%x) with flags 0x%x\n", c->frame, flags);
-                                start_resize(conn, c, bp->root_x, bp->root_y, flags);
-                            }
-                        }
-                    }
-                    xcb_flush(conn);
-                }
-                break;
-            }
-            case XCB_MOTION_NOTIFY: {
-                xcb_motion_notify_event_t *motion = (xcb_motion_notify_event_t *)event;
-                if (dragging && drag_client) {
-                    int dx = motion->root_x - drag_start_x;
-                    int dy = motion->root_y - drag_start_y;
-                    int new_x = frame_start_x + dx;
-                    int new_y = frame_start_y + dy;
-                    uint32_t values[2] = { new_x, new_y };
-                    xcb_configure_window(conn, drag_client->frame,
-                                         XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, values);
-                    xcb_flush(conn);
-                } else if (resizing && resize_client) {
-                    update_resize(conn, motion->root_x, motion->root_y);
-                }
-                break;
-            }
-            case XCB_BUTTON_RELEASE: {
-                if (dragging) {
-                    end_drag(conn);
-                }
-                if (resizing) {
-                    end_resize(conn);
-                }
-                break;
-            }
-            case XCB_DESTROY_NOTIFY: {
-                xcb_destroy_notify_event_t *dn = (xcb_destroy_notify_event_t *)event;
-                Client *c = find_client(dn->window);
-                if (c && dn->window == c->client) {
-                    fprintf(stderr, "etyWM Log: DESTROY_NOTIFY for client window 0x%x; destroying frame 0x%x\n", c->client, c->frame);
-                    xcb_destroy_window(conn, c->frame);
-                    remove_client_by_frame(c->frame);
-                }
+    atoms_init(conn);
+    resize_sync_init(conn);
+    title_init(conn, screen);
+    outputs_init(conn, screen);
+    spatial_init(screen->width_in_pixels, screen->height_in_pixels);
+    layout_init();
+    workspace_init(conn, screen);
+    if (COMPOSITOR)
+        compositor_init(conn, screen);
+
+    /* Have a few frames ready before the first window maps */
+    frame_pool_prewarm(conn, screen);
+
+    /* Frame whatever is already on screen (WM replaced or restarted) */
+    adopt_existing_windows(conn, screen);
+    layout_update(conn);
+    stack_update(conn);
+    titles_update(conn);
+
+    /* Start the helper programs on the autostart list */
+    launcher_autostart();
+
+    /* Wallpaper, scaled per output */
+    if (!set_root_background(conn, screen, BACKGROUND_IMAGE))
+        log_error("Failed to set the background");
+    compositor_screen_changed(conn, screen);
+    compositor_paint(conn);
+
+    /* Stats: SIGUSR1 dumps them to stderr, the socket serves them as JSON */
+    loop_add_signal(SIGUSR1, request_stats_dump);
+    loop_add_signal(SIGINT, request_exit);
+    loop_add_signal(SIGTERM, request_exit);
+    char sockets[96];
+    char stats_path[108];
+    int have_sockets = socket_dir(sockets, sizeof(sockets));
+    int stats_fd = have_sockets ? open_stats_socket(sockets, stats_path, sizeof(stats_path)) : -1;
+    if (stats_fd >= 0)
+        loop_add_fd(stats_fd, EPOLLIN, serve_stats, NULL);
+    control_init(conn, screen, have_sockets ? sockets : NULL);
+    /* Readable X input only needs to end the wait; it is read below */
+    loop_add_fd(xcb_get_file_descriptor(conn), EPOLLIN, NULL, NULL);
+
+    /* Main event loop: drain everything XCB has queued, coalesce it and
+     * dispatch the reduced batch. Once nothing is left, everything the
+     * batches produced goes out in one write and the loop blocks until X
+     * input, a stats reader, a timer or a signal needs it. That is the only
+     * place output is flushed, apart from the control socket answering a
+     * batch of commands: handlers just queue requests, and one that
+     * needs an answer waits on a reply, which flushes what is queued ahead
+     * of it. Writing can also read: input that arrives while the flush
+     * waits for the socket lands in XCB's queue, where epoll cannot see it,
+     * so the queue is checked again before blocking. */
+    static EventBatch batch;
+    while (running && !xcb_connection_has_error(conn)) {
+        xcb_generic_event_t *event = xcb_poll_for_event(conn);
+        if (!event) {
+            stats_flush();
+            xcb_flush(conn);
+            event = xcb_poll_for_queued_event(conn);
+            if (!event && !loop_wait())
                 break;
+        }
+        if (event) {
+            event_batch_fill(conn, &batch, event);
+            check_pending_grab(conn);
+            for (int i = 0; i < batch.len; i++) {
+                stats_begin_event(batch.ev[i]);
+                compositor_handle_event(conn, batch.ev[i]);
+                handle_event(conn, screen, batch.ev[i]);
+                stats_end_event();
+                free(batch.ev[i]);
             }
-            default:
-                break;
         }
-        free(event);
+        /* Timers and signals queue work too */
+        layout_update(conn);
+        stack_update(conn);
+        titles_update(conn);
+        compositor_paint(conn);
     }
 
-    fprintf(stderr, "etyWM Log: Exiting window manager\n");
+    log_info("Exiting window manager");
+    control_shutdown();
+    launcher_shutdown();
+    if (stats_fd >= 0) {
+        close(stats_fd);
+        unlink(stats_path);
+    }
+    int leaked = res_check();
+    log_shutdown();
+    dump_stats(stderr);
     xcb_disconnect(conn);
+    assert(leaked == 0);
+    (void)leaked;
     return 0;
 }
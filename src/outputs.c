@@ -0,0 +1,178 @@
+#include "outputs.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+#include <xcb/randr.h>
+#include "log.h"
+
+static Output outputs[MAX_OUTPUTS];
+static int outputs_len = 0;
+
+static int randr_present = 0;
+static uint8_t randr_first_event = 0;
+
+static void use_whole_screen(xcb_screen_t *screen)
+{
+    outputs[0].crtc = XCB_NONE;
+    outputs[0].x = 0;
+    outputs[0].y = 0;
+    outputs[0].width = screen->width_in_pixels;
+    outputs[0].height = screen->height_in_pixels;
+    outputs_len = 1;
+}
+
+/* Re-reads every CRTC: one round trip for the resources, one for all CRTC
+ * infos together. Returns 1 if the set of output rectangles changed. */
+static int read_outputs(xcb_connection_t *conn, xcb_screen_t *screen)
+{
+    Output old[MAX_OUTPUTS];
+    int old_len = outputs_len;
+    memcpy(old, outputs, sizeof(old));
+
+    xcb_randr_get_screen_resources_current_cookie_t res_cookie =
+        xcb_randr_get_screen_resources_current(conn, screen->root);
+    stats_round_trip();
+    xcb_randr_get_screen_resources_current_reply_t *res =
+        xcb_randr_get_screen_resources_current_reply(conn, res_cookie, NULL);
+    if (!res)
+    {
+        log_warn("Could not read RandR screen resources; using the whole screen");
+        use_whole_screen(screen);
+        return old_len != 1 || memcmp(old, outputs, sizeof(Output)) != 0;
+    }
+
+    int ncrtcs = xcb_randr_get_screen_resources_current_crtcs_length(res);
+    xcb_randr_crtc_t *crtcs = xcb_randr_get_screen_resources_current_crtcs(res);
+    xcb_randr_get_crtc_info_cookie_t *cookies = malloc(ncrtcs * sizeof(*cookies));
+    if (ncrtcs && !cookies)
+    {
+        log_error("Out of memory reading %d CRTCs", ncrtcs);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < ncrtcs; i++)
+        cookies[i] = xcb_randr_get_crtc_info(conn, crtcs[i], res->config_timestamp);
+    if (ncrtcs)
+        stats_round_trip();
+
+    outputs_len = 0;
+    for (int i = 0; i < ncrtcs; i++)
+    {
+        xcb_randr_get_crtc_info_reply_t *info = xcb_randr_get_crtc_info_reply(conn, cookies[i], NULL);
+        if (!info)
+            continue;
+        int active = info->mode != XCB_NONE && info->num_outputs > 0 && info->width && info->height;
+        for (int j = 0; active && j < outputs_len; j++)
+        {
+            if (outputs[j].x == info->x && outputs[j].y == info->y &&
+                outputs[j].width == info->width && outputs[j].height == info->height)
+                active = 0; /* Mirror of an output we already have */
+        }
+        if (active && outputs_len < MAX_OUTPUTS)
+        {
+            Output *o = &outputs[outputs_len++];
+            o->crtc = crtcs[i];
+            o->x = info->x;
+            o->y = info->y;
+            o->width = info->width;
+            o->height = info->height;
+        }
+        free(info);
+    }
+    free(cookies);
+    free(res);
+
+    /* All outputs disabled (e.g. mid-hotplug): keep something sensible */
+    if (outputs_len == 0)
+        use_whole_screen(screen);
+
+    return outputs_len != old_len || memcmp(old, outputs, outputs_len * sizeof(Output)) != 0;
+}
+
+int outputs_init(xcb_connection_t *conn, xcb_screen_t *screen)
+{
+    const xcb_query_extension_reply_t *ext = xcb_get_extension_data(conn, &xcb_randr_id);
+    if (!ext || !ext->present)
+    {
+        log_warn("RandR extension missing; treating the screen as one output");
+        use_whole_screen(screen);
+        return 0;
+    }
+    randr_first_event = ext->first_event;
+    randr_present = 1;
+
+    /* Version 1.3 is needed for GetScreenResourcesCurrent; requests are
+     * processed in order, so the version reply need not be waited for */
+    xcb_randr_query_version_cookie_t cookie = xcb_randr_query_version(conn, 1, 3);
+    xcb_discard_reply(conn, cookie.sequence);
+    xcb_randr_select_input(conn, screen->root, XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE);
+
+    read_outputs(conn, screen);
+    for (int i = 0; i < outputs_len; i++)
+        log_info("Output %d: %dx%d at (%d,%d)", i, outputs[i].width, outputs[i].height,
+                 outputs[i].x, outputs[i].y);
+    return 1;
+}
+
+int outputs_handle_event(xcb_connection_t *conn, xcb_screen_t *screen, xcb_generic_event_t *ev)
+{
+    if (!randr_present ||
+        (ev->response_type & ~0x80) != randr_first_event + XCB_RANDR_SCREEN_CHANGE_NOTIFY)
+        return 0;
+
+    xcb_randr_screen_change_notify_event_t *sc = (xcb_randr_screen_change_notify_event_t *)ev;
+    if (sc->root != screen->root)
+        return 0;
+
+    /* The setup data is ours to keep current; everything else reads the
+     * screen size from it */
+    int old_width = screen->width_in_pixels, old_height = screen->height_in_pixels;
+    if (sc->rotation & (XCB_RANDR_ROTATION_ROTATE_90 | XCB_RANDR_ROTATION_ROTATE_270))
+    {
+        screen->width_in_pixels = sc->height;
+        screen->height_in_pixels = sc->width;
+    }
+    else
+    {
+        screen->width_in_pixels = sc->width;
+        screen->height_in_pixels = sc->height;
+    }
+
+    /* The framebuffer can be resized with the CRTCs left as they are */
+    int resized = screen->width_in_pixels != old_width || screen->height_in_pixels != old_height;
+    if (!read_outputs(conn, screen) && !resized)
+        return 0;
+    log_info("Outputs changed: %d active, screen %dx%d", outputs_len,
+             screen->width_in_pixels, screen->height_in_pixels);
+    return 1;
+}
+
+int output_count(void)
+{
+    return outputs_len;
+}
+
+const Output *output_at(int n)
+{
+    return (n >= 0 && n < outputs_len) ? &outputs[n] : NULL;
+}
+
+const Output *output_for_rect(int x, int y, int width, int height)
+{
+    const Output *best = &outputs[0];
+    long best_area = 0;
+    for (int i = 0; i < outputs_len; i++)
+    {
+        const Output *o = &outputs[i];
+        int w = (x + width < o->x + o->width ? x + width : o->x + o->width) - (x > o->x ? x : o->x);
+        int h = (y + height < o->y + o->height ? y + height : o->y + o->height) - (y > o->y ? y : o->y);
+        long area = (w > 0 && h > 0) ? (long)w * h : 0;
+        if (area > best_area)
+        {
+            best = o;
+            best_area = area;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,35 @@
+#ifndef OUTPUTS_H
+#define OUTPUTS_H
+
+#include <xcb/xcb.h>
+
+#define MAX_OUTPUTS 16
+
+/* A monitor's rectangle on the root window (one active RandR CRTC; mirrored
+ * CRTCs showing the same area count once) */
+typedef struct Output {
+    uint32_t crtc; /* xcb_randr_crtc_t, XCB_NONE without RandR */
+    int x, y;
+    int width, height;
+} Output;
+
+/* Reads the current outputs and subscribes to RandR screen changes.
+ * Without RandR the whole screen is treated as a single output.
+ * Returns 1 if RandR is in use.
+ */
+int outputs_init(xcb_connection_t *conn, xcb_screen_t *screen);
+
+/* Handles RRScreenChangeNotify: updates the screen size and re-reads the
+ * outputs. Returns 1 if 'ev' was such an event and any output or the screen
+ * size changed.
+ */
+int outputs_handle_event(xcb_connection_t *conn, xcb_screen_t *screen, xcb_generic_event_t *ev);
+
+int output_count(void);
+const Output *output_at(int n);
+
+/* The output holding most of the given rectangle (the first output if it is
+ * on none of them) */
+const Output *output_for_rect(int x, int y, int width, int height);
+
+#endif // OUTPUTS_H
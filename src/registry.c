@@ -0,0 +1,254 @@
+#include "client.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include "log.h"
+
+/*
+ * Client registry.
+ *
+ * Managed clients live in a dense table of Client pointers (swap-removed, so
+ * iteration never walks holes).  Every XID a client owns -- frame, title and
+ * client window -- is entered into an open-addressing index that maps the XID
+ * straight to its Client.  The index uses linear probing with backward-shift
+ * deletion, so there are no tombstones and lookups stay O(1) regardless of how
+ * many clients come and go.  XCB_NONE (0) is never a valid XID and marks an
+ * empty slot.
+ */
+
+#define INDEX_MIN_BITS 6 /* 64 slots */
+
+/* Client records are carved out of slabs and recycled through a free list;
+ * slabs are never returned, the high-water mark bounds what they hold. */
+#define CLIENT_SLAB_SIZE 64
+
+typedef union ClientSlot
+{
+    Client client;
+    union ClientSlot *next_free;
+} ClientSlot;
+
+static ClientSlot *client_free_list = NULL;
+static int client_slabs = 0;
+static int clients_live = 0;
+static int clients_high = 0;
+
+typedef struct
+{
+    xcb_window_t win;
+    Client *c;
+} IndexSlot;
+
+static Client **table = NULL;
+static int table_len = 0;
+static int table_cap = 0;
+
+static IndexSlot *index_slots = NULL;
+static unsigned index_bits = 0;
+static uint32_t index_used = 0;
+
+/* Fibonacci hashing: XIDs are allocated sequentially from a per-connection
+ * base, so a multiplicative hash spreads them evenly over the index. */
+static inline uint32_t index_home(xcb_window_t win)
+{
+    return (uint32_t)(win * 2654435769u) >> (32 - index_bits);
+}
+
+static void index_put(xcb_window_t win, Client *c)
+{
+    uint32_t mask = (1u << index_bits) - 1;
+    uint32_t i = index_home(win);
+    while (index_slots[i].win != XCB_NONE && index_slots[i].win != win)
+        i = (i + 1) & mask;
+    if (index_slots[i].win == XCB_NONE)
+        index_used++;
+    index_slots[i].win = win;
+    index_slots[i].c = c;
+}
+
+static void index_del(xcb_window_t win)
+{
+    uint32_t mask = (1u << index_bits) - 1;
+    uint32_t i = index_home(win);
+    while (index_slots[i].win != win)
+    {
+        if (index_slots[i].win == XCB_NONE)
+            return;
+        i = (i + 1) & mask;
+    }
+
+    /* Shift later members of the probe run back into the hole so no lookup
+     * ever stops early on it. */
+    uint32_t j = i;
+    for (;;)
+    {
+        j = (j + 1) & mask;
+        if (index_slots[j].win == XCB_NONE)
+            break;
+        uint32_t k = index_home(index_slots[j].win);
+        int stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (stays)
+            continue;
+        index_slots[i] = index_slots[j];
+        i = j;
+    }
+    index_slots[i].win = XCB_NONE;
+    index_slots[i].c = NULL;
+    index_used--;
+}
+
+static void index_add_client(Client *c)
+{
+    if (c->frame != XCB_NONE)
+        index_put(c->frame, c);
+    if (c->title != XCB_NONE)
+        index_put(c->title, c);
+    if (c->client != XCB_NONE)
+        index_put(c->client, c);
+}
+
+/* Keep the index at most half full; rebuild it from the dense table when it
+ * has to grow. */
+static int index_reserve(uint32_t entries)
+{
+    unsigned bits = index_bits ? index_bits : INDEX_MIN_BITS;
+    while ((1u << bits) < entries * 2)
+        bits++;
+    if (index_slots && bits == index_bits)
+        return 1;
+
+    IndexSlot *slots = calloc(1u << bits, sizeof(IndexSlot));
+    if (!slots)
+        return 0;
+    free(index_slots);
+    index_slots = slots;
+    index_bits = bits;
+    index_used = 0;
+    for (int n = 0; n < table_len; n++)
+        index_add_client(table[n]);
+    return 1;
+}
+
+Client *client_alloc(void)
+{
+    if (!client_free_list)
+    {
+        ClientSlot *slab = malloc(CLIENT_SLAB_SIZE * sizeof(ClientSlot));
+        if (!slab)
+        {
+            log_error("Out of memory when allocating Client structure");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < CLIENT_SLAB_SIZE; i++)
+        {
+            slab[i].next_free = client_free_list;
+            client_free_list = &slab[i];
+        }
+        client_slabs++;
+    }
+
+    ClientSlot *slot = client_free_list;
+    client_free_list = slot->next_free;
+    memset(&slot->client, 0, sizeof(Client));
+    if (++clients_live > clients_high)
+        clients_high = clients_live;
+    return &slot->client;
+}
+
+static void client_free(Client *c)
+{
+    ClientSlot *slot = (ClientSlot *)c;
+    slot->next_free = client_free_list;
+    client_free_list = slot;
+    clients_live--;
+}
+
+void client_slab_report(FILE *out)
+{
+    fprintf(out, "etyWM Stats: client slab %d live (high-water %d), %d slabs of %d\n",
+            clients_live, clients_high, client_slabs, CLIENT_SLAB_SIZE);
+}
+
+void add_client(Client *c)
+{
+    if (!c)
+    {
+        log_warn("Tried to add a NULL client");
+        return;
+    }
+
+    if (table_len == table_cap)
+    {
+        int cap = table_cap ? table_cap * 2 : 64;
+        Client **grown = realloc(table, cap * sizeof(Client *));
+        if (!grown)
+        {
+            log_error("Out of memory growing client table");
+            exit(EXIT_FAILURE);
+        }
+        table = grown;
+        table_cap = cap;
+    }
+    if (!index_reserve(index_used + 3))
+    {
+        log_error("Out of memory growing client index");
+        exit(EXIT_FAILURE);
+    }
+
+    c->index = table_len;
+    table[table_len++] = c;
+    index_add_client(c);
+    log_info("Added client (frame 0x%x)", c->frame);
+}
+
+void remove_client_by_frame(xcb_window_t frame)
+{
+    Client *c = find_client(frame);
+    if (!c || c->frame != frame)
+    {
+        log_warn("No client found with frame 0x%x to remove", frame);
+        return;
+    }
+
+    index_del(c->frame);
+    if (c->title != XCB_NONE)
+        index_del(c->title);
+    if (c->client != XCB_NONE)
+        index_del(c->client);
+
+    Client *last = table[--table_len];
+    table[c->index] = last;
+    last->index = c->index;
+
+    log_info("Removing client (frame 0x%x)", frame);
+    client_free(c);
+}
+
+Client *find_client(xcb_window_t win)
+{
+    if (!index_slots || win == XCB_NONE)
+        return NULL;
+
+    uint32_t mask = (1u << index_bits) - 1;
+    uint32_t i = index_home(win);
+    for (;;)
+    {
+        xcb_window_t w = index_slots[i].win;
+        if (w == win)
+            return index_slots[i].c;
+        if (w == XCB_NONE)
+            return NULL;
+        i = (i + 1) & mask;
+    }
+}
+
+int client_count(void)
+{
+    return table_len;
+}
+
+Client *client_at(int n)
+{
+    return (n >= 0 && n < table_len) ? table[n] : NULL;
+}
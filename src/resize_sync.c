@@ -0,0 +1,172 @@
+#include "resize_sync.h"
+#include "atoms.h"
+#include "resources.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+#include <xcb/xproto.h>
+#include <xcb/sync.h>
+#include "log.h"
+
+static int sync_present = 0;
+static uint8_t sync_first_event = 0;
+
+static xcb_sync_int64_t to_int64(uint64_t v)
+{
+    xcb_sync_int64_t r;
+    r.hi = (int32_t)(v >> 32);
+    r.lo = (uint32_t)v;
+    return r;
+}
+
+static uint64_t from_int64(xcb_sync_int64_t v)
+{
+    return ((uint64_t)(uint32_t)v.hi << 32) | v.lo;
+}
+
+int resize_sync_init(xcb_connection_t *conn)
+{
+    const xcb_query_extension_reply_t *ext = xcb_get_extension_data(conn, &xcb_sync_id);
+    if (!ext || !ext->present)
+    {
+        log_warn("XSync extension missing; resizes will not be synchronized");
+        return 0;
+    }
+    sync_first_event = ext->first_event;
+
+    /* XSync must be initialized before use; the version reply is not needed */
+    xcb_sync_initialize_cookie_t cookie = xcb_sync_initialize(conn, 3, 1);
+    xcb_discard_reply(conn, cookie.sequence);
+    sync_present = 1;
+    return 1;
+}
+
+void resize_sync_query(xcb_connection_t *conn, Client *c)
+{
+    if (!sync_present || atoms[ATOM_NET_WM_SYNC_REQUEST_COUNTER] == XCB_ATOM_NONE)
+        return;
+
+    c->sync_protocols_seq = xcb_get_property(conn, 0, c->client, atoms[ATOM_WM_PROTOCOLS],
+                                             XCB_ATOM_ATOM, 0, 32).sequence;
+    c->sync_counter_seq = xcb_get_property(conn, 0, c->client, atoms[ATOM_NET_WM_SYNC_REQUEST_COUNTER],
+                                           XCB_ATOM_CARDINAL, 0, 1).sequence;
+    c->sync_query_pending = 1;
+}
+
+int resize_sync_supported(xcb_connection_t *conn, Client *c)
+{
+    if (c->sync_query_pending)
+    {
+        xcb_get_property_reply_t *protocols = NULL, *counter = NULL;
+        xcb_generic_error_t *error = NULL;
+
+        /* Replies arrive in order, so once the later one is in both are */
+        if (!xcb_poll_for_reply(conn, c->sync_counter_seq, (void **)&counter, &error))
+            return 0;
+        free(error);
+        error = NULL;
+        xcb_poll_for_reply(conn, c->sync_protocols_seq, (void **)&protocols, &error);
+        free(error);
+        c->sync_query_pending = 0;
+
+        int advertised = 0;
+        if (protocols && protocols->format == 32)
+        {
+            xcb_atom_t *list = xcb_get_property_value(protocols);
+            int n = xcb_get_property_value_length(protocols) / 4;
+            for (int i = 0; i < n; i++)
+                if (list[i] == atoms[ATOM_NET_WM_SYNC_REQUEST])
+                    advertised = 1;
+        }
+        if (advertised && counter && counter->format == 32 && xcb_get_property_value_length(counter) >= 4)
+        {
+            c->sync_counter = *(uint32_t *)xcb_get_property_value(counter);
+            log_info("Client 0x%x supports _NET_WM_SYNC_REQUEST (counter 0x%x)",
+                    c->client, c->sync_counter);
+        }
+        free(protocols);
+        free(counter);
+    }
+    return c->sync_counter != XCB_NONE;
+}
+
+void resize_sync_begin(xcb_connection_t *conn, Client *c)
+{
+    if (c->sync_counter == XCB_NONE || c->sync_alarm != XCB_NONE)
+        return;
+
+    xcb_sync_create_alarm_value_list_t values;
+    memset(&values, 0, sizeof(values));
+    values.counter = c->sync_counter;
+    values.valueType = XCB_SYNC_VALUETYPE_ABSOLUTE;
+    values.value = to_int64(c->sync_value);
+    values.testType = XCB_SYNC_TESTTYPE_POSITIVE_COMPARISON;
+    values.delta = to_int64(0);
+    values.events = 1;
+
+    c->sync_alarm = res_new(conn, RES_ALARM, c->client);
+    xcb_sync_create_alarm_aux(conn, c->sync_alarm,
+                              XCB_SYNC_CA_COUNTER | XCB_SYNC_CA_VALUE_TYPE | XCB_SYNC_CA_VALUE |
+                                  XCB_SYNC_CA_TEST_TYPE | XCB_SYNC_CA_DELTA | XCB_SYNC_CA_EVENTS,
+                              &values);
+}
+
+void resize_sync_end(xcb_connection_t *conn, Client *c)
+{
+    if (c->sync_alarm == XCB_NONE)
+        return;
+    xcb_sync_destroy_alarm(conn, c->sync_alarm);
+    res_free(c->sync_alarm);
+    c->sync_alarm = XCB_NONE;
+}
+
+void resize_sync_request(xcb_connection_t *conn, Client *c, xcb_timestamp_t time)
+{
+    if (c->sync_alarm == XCB_NONE)
+        return;
+
+    c->sync_value++;
+
+    xcb_client_message_event_t ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.response_type = XCB_CLIENT_MESSAGE;
+    ev.format = 32;
+    ev.window = c->client;
+    ev.type = atoms[ATOM_WM_PROTOCOLS];
+    ev.data.data32[0] = atoms[ATOM_NET_WM_SYNC_REQUEST];
+    ev.data.data32[1] = time;
+    ev.data.data32[2] = (uint32_t)c->sync_value;
+    ev.data.data32[3] = (uint32_t)(c->sync_value >> 32);
+    xcb_send_event(conn, 0, c->client, XCB_EVENT_MASK_NO_EVENT, (const char *)&ev);
+
+    /* Re-arm the alarm for the value the client will set once it has redrawn */
+    xcb_sync_change_alarm_value_list_t values;
+    memset(&values, 0, sizeof(values));
+    values.value = to_int64(c->sync_value);
+    values.events = 1;
+    xcb_sync_change_alarm_aux(conn, c->sync_alarm, XCB_SYNC_CA_VALUE | XCB_SYNC_CA_EVENTS, &values);
+}
+
+int resize_sync_is_ack(Client *c, xcb_generic_event_t *event)
+{
+    if (!sync_present || c->sync_alarm == XCB_NONE)
+        return 0;
+    if ((event->response_type & ~0x80) != sync_first_event + XCB_SYNC_ALARM_NOTIFY)
+        return 0;
+
+    xcb_sync_alarm_notify_event_t *an = (xcb_sync_alarm_notify_event_t *)event;
+    return an->alarm == c->sync_alarm && from_int64(an->counter_value) >= c->sync_value;
+}
+
+void resize_sync_forget(xcb_connection_t *conn, Client *c)
+{
+    if (c->sync_query_pending)
+    {
+        xcb_discard_reply(conn, c->sync_protocols_seq);
+        xcb_discard_reply(conn, c->sync_counter_seq);
+        c->sync_query_pending = 0;
+    }
+    resize_sync_end(conn, c);
+}
@@ -0,0 +1,42 @@
+#ifndef RESIZE_SYNC_H
+#define RESIZE_SYNC_H
+
+#include <xcb/xcb.h>
+#include "client.h"
+
+/* _NET_WM_SYNC_REQUEST support for interactive resizes.
+ *
+ * A client that advertises the protocol gets a sync request before each
+ * configure; the WM holds back the next size until the client's XSync
+ * counter reaches the requested value (reported through an XSync alarm).
+ */
+
+/* Sets up the XSync extension; call once after atoms_init().
+ * Returns 0 if the server lacks XSync (sync is then never used).
+ */
+int resize_sync_init(xcb_connection_t *conn);
+
+/* Requests the client's WM_PROTOCOLS and _NET_WM_SYNC_REQUEST_COUNTER
+ * without waiting for the replies.
+ */
+void resize_sync_query(xcb_connection_t *conn, Client *c);
+
+/* Collects the replies of resize_sync_query() if they have arrived.
+ * Returns 1 if the client supports the protocol. Never blocks.
+ */
+int resize_sync_supported(xcb_connection_t *conn, Client *c);
+
+/* Arms and disarms the alarm used while 'c' is being resized */
+void resize_sync_begin(xcb_connection_t *conn, Client *c);
+void resize_sync_end(xcb_connection_t *conn, Client *c);
+
+/* Sends a sync request for the configure that is about to follow */
+void resize_sync_request(xcb_connection_t *conn, Client *c, xcb_timestamp_t time);
+
+/* Returns 1 if 'event' acknowledges the last sync request sent to 'c' */
+int resize_sync_is_ack(Client *c, xcb_generic_event_t *event);
+
+/* Releases sync state of a client that is going away */
+void resize_sync_forget(xcb_connection_t *conn, Client *c);
+
+#endif // RESIZE_SYNC_H
@@ -0,0 +1,321 @@
+#include "resources.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include "log.h"
+
+/*
+ * Resource table.
+ *
+ * Live resources are kept in an open-addressing table keyed by XID, with
+ * linear probing and backward-shift deletion like the client index in
+ * registry.c.  Destroying a window walks the whole table for what it owned,
+ * once for it and once for each of its child windows; windows are destroyed
+ * rarely enough that this costs less than keeping per-owner lists up to date
+ * on every allocation.
+ */
+
+#define TABLE_MIN_BITS 8 /* 256 slots */
+
+/* Owners listed by res_report() */
+#define REPORT_TOP_OWNERS 5
+
+typedef struct
+{
+    uint32_t id;
+    xcb_window_t owner;
+    uint8_t type;
+    uint8_t bound;  /* Freed by the server with its owner */
+    uint8_t orphan; /* Outlived its owner */
+} Resource;
+
+#define RES_NAME(name, str) str,
+static const char *const type_names[RES_TYPE_COUNT] = { RES_LIST(RES_NAME) };
+#undef RES_NAME
+
+static Resource *slots = NULL;
+static unsigned slots_bits = 0;
+static uint32_t slots_used = 0;
+
+static int live[RES_TYPE_COUNT];
+static int live_high = 0;
+static unsigned long created[RES_TYPE_COUNT];
+static int orphans = 0;
+
+static inline uint32_t home(uint32_t id)
+{
+    return (uint32_t)(id * 2654435769u) >> (32 - slots_bits);
+}
+
+static Resource *lookup(uint32_t id)
+{
+    if (!slots)
+        return NULL;
+    uint32_t mask = (1u << slots_bits) - 1;
+    for (uint32_t i = home(id); slots[i].id != XCB_NONE; i = (i + 1) & mask)
+    {
+        if (slots[i].id == id)
+            return &slots[i];
+    }
+    return NULL;
+}
+
+static void put(const Resource *r)
+{
+    uint32_t mask = (1u << slots_bits) - 1;
+    uint32_t i = home(r->id);
+    while (slots[i].id != XCB_NONE)
+        i = (i + 1) & mask;
+    slots[i] = *r;
+    slots_used++;
+}
+
+/* Keeps the table at most half full */
+static void reserve(uint32_t entries)
+{
+    unsigned bits = slots_bits ? slots_bits : TABLE_MIN_BITS;
+    while ((1u << bits) < entries * 2)
+        bits++;
+    if (slots && bits == slots_bits)
+        return;
+
+    Resource *old = slots;
+    uint32_t old_size = old ? 1u << slots_bits : 0;
+    slots = calloc(1u << bits, sizeof(Resource));
+    if (!slots)
+    {
+        log_error("Out of memory tracking X resources");
+        exit(EXIT_FAILURE);
+    }
+    slots_bits = bits;
+    slots_used = 0;
+    for (uint32_t i = 0; i < old_size; i++)
+    {
+        if (old[i].id != XCB_NONE)
+            put(&old[i]);
+    }
+    free(old);
+}
+
+static void del(Resource *r)
+{
+    uint32_t mask = (1u << slots_bits) - 1;
+    uint32_t i = r - slots;
+
+    live[r->type]--;
+    if (r->orphan)
+        orphans--;
+
+    uint32_t j = i;
+    for (;;)
+    {
+        j = (j + 1) & mask;
+        if (slots[j].id == XCB_NONE)
+            break;
+        uint32_t k = home(slots[j].id);
+        int stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (stays)
+            continue;
+        slots[i] = slots[j];
+        i = j;
+    }
+    memset(&slots[i], 0, sizeof(Resource));
+    slots_used--;
+}
+
+static uint32_t add(xcb_connection_t *conn, ResType type, xcb_window_t owner, int bound)
+{
+    uint32_t id = xcb_generate_id(conn);
+    if (id == (uint32_t)-1)
+    {
+        log_error("Out of X resource IDs");
+        exit(EXIT_FAILURE);
+    }
+    reserve(slots_used + 1);
+    Resource r = { .id = id, .owner = owner, .type = type, .bound = bound };
+    put(&r);
+
+    live[type]++;
+    created[type]++;
+    int total = 0;
+    for (int t = 0; t < RES_TYPE_COUNT; t++)
+        total += live[t];
+    if (total > live_high)
+        live_high = total;
+    return id;
+}
+
+uint32_t res_new(xcb_connection_t *conn, ResType type, xcb_window_t owner)
+{
+    return add(conn, type, owner, 0);
+}
+
+uint32_t res_new_on(xcb_connection_t *conn, ResType type, xcb_window_t window)
+{
+    return add(conn, type, window, 1);
+}
+
+/* Resources being dropped by owner_gone() */
+static uint32_t *doomed = NULL;
+static int doomed_len = 0, doomed_cap = 0;
+
+/* Lists what 'owner' bound and marks whatever else it owned as orphaned */
+static void collect(xcb_window_t owner)
+{
+    uint32_t size = 1u << slots_bits;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        Resource *r = &slots[i];
+        if (r->id == XCB_NONE || r->owner != owner)
+            continue;
+        if (!r->bound)
+        {
+            if (!r->orphan)
+            {
+                r->orphan = 1;
+                orphans++;
+                log_warn("X resource 0x%x (%s) outlived its owner 0x%x", r->id, type_names[r->type], owner);
+            }
+            continue;
+        }
+        if (doomed_len == doomed_cap)
+        {
+            int cap = doomed_cap ? doomed_cap * 2 : 64;
+            uint32_t *grown = realloc(doomed, cap * sizeof(uint32_t));
+            if (!grown)
+            {
+                log_error("Out of memory tracking X resources");
+                exit(EXIT_FAILURE);
+            }
+            doomed = grown;
+            doomed_cap = cap;
+        }
+        doomed[doomed_len++] = r->id;
+    }
+}
+
+/* Drops what the server freed with 'owner' and its child windows and marks
+ * whatever else they owned as orphaned.  Everything is listed first, one
+ * scan per window destroyed, and deleted afterwards, since deleting shifts
+ * entries around under a scan. */
+static void owner_gone(xcb_window_t owner)
+{
+    if (!slots || owner == XCB_NONE)
+        return;
+
+    doomed_len = 0;
+    collect(owner);
+    for (int i = 0; i < doomed_len; i++)
+    {
+        const Resource *r = lookup(doomed[i]);
+        if (r->type == RES_WINDOW)
+            collect(r->id);
+    }
+    for (int i = 0; i < doomed_len; i++)
+        del(lookup(doomed[i]));
+}
+
+void res_free(uint32_t id)
+{
+    Resource *r = lookup(id);
+    if (!r)
+    {
+        log_debug("Freeing untracked X resource 0x%x", id);
+        return;
+    }
+    int window = r->type == RES_WINDOW;
+    del(r);
+    if (window)
+        owner_gone(id);
+}
+
+void res_window_destroyed(xcb_window_t window)
+{
+    Resource *r = lookup(window);
+    if (r && r->type == RES_WINDOW)
+        del(r);
+    owner_gone(window);
+}
+
+void res_report(FILE *out)
+{
+    fprintf(out, "etyWM Stats: X resources live:");
+    int total = 0;
+    for (int t = 0; t < RES_TYPE_COUNT; t++)
+    {
+        fprintf(out, "%s %d %s", t ? "," : "", live[t], type_names[t]);
+        total += live[t];
+    }
+    fprintf(out, " (%d total, high-water %d), %d orphaned\n", total, live_high, orphans);
+
+    fprintf(out, "etyWM Stats: X resources created:");
+    for (int t = 0; t < RES_TYPE_COUNT; t++)
+        fprintf(out, "%s %lu %s", t ? "," : "", created[t], type_names[t]);
+    fprintf(out, "\n");
+
+    /* Tally per owner; the WM's own resources (XCB_NONE) are the totals above */
+    typedef struct
+    {
+        xcb_window_t owner;
+        int count[RES_TYPE_COUNT];
+        int total;
+    } OwnerCount;
+    OwnerCount *owners = calloc(total ? total : 1, sizeof(*owners));
+    if (!owners)
+        return;
+    int nowners = 0;
+    uint32_t size = slots ? 1u << slots_bits : 0;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        const Resource *r = &slots[i];
+        if (r->id == XCB_NONE || r->owner == XCB_NONE)
+            continue;
+        int k = 0;
+        while (k < nowners && owners[k].owner != r->owner)
+            k++;
+        if (k == nowners)
+            owners[nowners++].owner = r->owner;
+        owners[k].count[r->type]++;
+        owners[k].total++;
+    }
+
+    for (int n = 0; n < REPORT_TOP_OWNERS && n < nowners; n++)
+    {
+        int best = n;
+        for (int k = n + 1; k < nowners; k++)
+        {
+            if (owners[k].total > owners[best].total)
+                best = k;
+        }
+        OwnerCount top = owners[best];
+        owners[best] = owners[n];
+        owners[n] = top;
+
+        fprintf(out, "etyWM Stats:   owner 0x%x:", top.owner);
+        int first = 1;
+        for (int t = 0; t < RES_TYPE_COUNT; t++)
+        {
+            if (!top.count[t])
+                continue;
+            fprintf(out, "%s %d %s", first ? "" : ",", top.count[t], type_names[t]);
+            first = 0;
+        }
+        fprintf(out, "\n");
+    }
+    free(owners);
+}
+
+int res_check(void)
+{
+    if (!orphans)
+        return 0;
+    uint32_t size = 1u << slots_bits;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        const Resource *r = &slots[i];
+        if (r->id != XCB_NONE && r->orphan)
+            log_error("Leaked X resource 0x%x (%s), owner 0x%x", r->id, type_names[r->type], r->owner);
+    }
+    return orphans;
+}
@@ -0,0 +1,57 @@
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+#include <stdio.h>
+#include <xcb/xcb.h>
+
+/* Accounting of the X resources etyWM creates.
+ *
+ * Every XID from xcb_generate_id() is taken through res_new() or
+ * res_new_on() and given back with res_free() next to the request that
+ * frees it, so the live set per type and per owner is always known. The
+ * owner is the window a resource belongs to (XCB_NONE for the WM itself):
+ *
+ *   res_new()    - the resource must be freed before its owner goes; if the
+ *                  owner is destroyed first it is reported as orphaned.
+ *   res_new_on() - the server frees it together with the window (a child
+ *                  window, a picture or damage object on it).
+ *
+ * To track another kind of resource, append it to RES_LIST.
+ */
+#define RES_LIST(X)              \
+    X(WINDOW,  "windows")        \
+    X(PIXMAP,  "pixmaps")        \
+    X(GC,      "gcs")            \
+    X(PICTURE, "pictures")       \
+    X(REGION,  "regions")        \
+    X(DAMAGE,  "damages")        \
+    X(ALARM,   "alarms")         \
+    X(SHMSEG,  "shm segments")   \
+    X(CURSOR,  "cursors")        \
+    X(FONT,    "fonts")
+
+#define RES_ENUM(name, str) RES_##name,
+typedef enum {
+    RES_LIST(RES_ENUM)
+    RES_TYPE_COUNT
+} ResType;
+#undef RES_ENUM
+
+/* Allocates an XID for a resource of 'type' owned by 'owner' */
+uint32_t res_new(xcb_connection_t *conn, ResType type, xcb_window_t owner);
+uint32_t res_new_on(xcb_connection_t *conn, ResType type, xcb_window_t window);
+
+/* The resource was freed. Freeing a window also drops everything the
+ * server frees along with it. */
+void res_free(uint32_t id);
+
+/* A window was destroyed (DestroyNotify), by us or by its client */
+void res_window_destroyed(xcb_window_t window);
+
+/* Live counts per type, the owners holding the most, and orphans */
+void res_report(FILE *out);
+
+/* Logs every orphaned resource; returns how many there are */
+int res_check(void);
+
+#endif // RESOURCES_H
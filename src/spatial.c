@@ -0,0 +1,293 @@
+#include "spatial.h"
+#include "config.h"
+#include "workspace.h"
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+
+/*
+ * Grid cells hold unordered arrays of clients; a frame is filed in every
+ * cell it overlaps and remembers the cell range so it can be taken out
+ * again without searching.  Frames partly off screen are clamped to the
+ * border cells.  Which of several overlapping frames is on top comes from
+ * the stacking order etyWM keeps (stack.c).
+ */
+
+#define SPATIAL_CELL 256
+
+typedef struct
+{
+    Client **v;
+    int len, cap;
+} Cell;
+
+static Cell *cells = NULL;
+static int cols = 0, rows = 0;
+static int root_width = 0, root_height = 0;
+
+static unsigned long updates = 0;
+static unsigned long refiled = 0;
+static unsigned long point_queries = 0;
+static unsigned long free_queries = 0;
+static unsigned long free_found = 0;
+static unsigned long candidates_tested = 0;
+
+static inline int clamp(int v, int lo, int hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+static inline int visible(const Client *c)
+{
+    return c->workspace == workspace_current() && !c->withdrawn;
+}
+
+static void cell_add(Cell *cell, Client *c)
+{
+    if (cell->len == cell->cap)
+    {
+        int cap = cell->cap ? cell->cap * 2 : 8;
+        Client **grown = realloc(cell->v, cap * sizeof(Client *));
+        if (!grown)
+        {
+            log_error("Out of memory indexing frame 0x%x", c->frame);
+            exit(EXIT_FAILURE);
+        }
+        cell->v = grown;
+        cell->cap = cap;
+    }
+    cell->v[cell->len++] = c;
+}
+
+static void cell_del(Cell *cell, Client *c)
+{
+    for (int i = 0; i < cell->len; i++)
+    {
+        if (cell->v[i] == c)
+        {
+            cell->v[i] = cell->v[--cell->len];
+            return;
+        }
+    }
+}
+
+/* Cells covered by a rectangle, clamped to the grid */
+static void cell_range(int x, int y, int width, int height, int *x0, int *y0, int *x1, int *y1)
+{
+    *x0 = clamp(x, 0, root_width - 1) / SPATIAL_CELL;
+    *y0 = clamp(y, 0, root_height - 1) / SPATIAL_CELL;
+    *x1 = clamp(x + width - 1, 0, root_width - 1) / SPATIAL_CELL;
+    *y1 = clamp(y + height - 1, 0, root_height - 1) / SPATIAL_CELL;
+}
+
+static void file(Client *c)
+{
+    cell_range(c->x, c->y, c->width, c->height, &c->grid_x0, &c->grid_y0, &c->grid_x1, &c->grid_y1);
+    for (int cy = c->grid_y0; cy <= c->grid_y1; cy++)
+    {
+        for (int cx = c->grid_x0; cx <= c->grid_x1; cx++)
+            cell_add(&cells[cy * cols + cx], c);
+    }
+    c->grid_filed = 1;
+}
+
+static void unfile(Client *c)
+{
+    for (int cy = c->grid_y0; cy <= c->grid_y1; cy++)
+    {
+        for (int cx = c->grid_x0; cx <= c->grid_x1; cx++)
+            cell_del(&cells[cy * cols + cx], c);
+    }
+    c->grid_filed = 0;
+}
+
+void spatial_init(int width, int height)
+{
+    if (cells)
+    {
+        for (int i = 0; i < cols * rows; i++)
+            free(cells[i].v);
+        free(cells);
+    }
+    root_width = width > 0 ? width : 1;
+    root_height = height > 0 ? height : 1;
+    cols = (root_width + SPATIAL_CELL - 1) / SPATIAL_CELL;
+    rows = (root_height + SPATIAL_CELL - 1) / SPATIAL_CELL;
+    cells = calloc(cols * rows, sizeof(Cell));
+    if (!cells)
+    {
+        log_error("Out of memory sizing the spatial index");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < client_count(); i++)
+    {
+        Client *c = client_at(i);
+        if (c->grid_filed)
+            file(c);
+    }
+}
+
+void spatial_update(Client *c)
+{
+    updates++;
+    if (c->grid_filed)
+    {
+        int x0, y0, x1, y1;
+        cell_range(c->x, c->y, c->width, c->height, &x0, &y0, &x1, &y1);
+        if (x0 == c->grid_x0 && y0 == c->grid_y0 && x1 == c->grid_x1 && y1 == c->grid_y1)
+            return;
+        unfile(c);
+    }
+    refiled++;
+    file(c);
+}
+
+void spatial_remove(Client *c)
+{
+    if (c->grid_filed)
+        unfile(c);
+}
+
+Client *spatial_client_at(int x, int y)
+{
+    point_queries++;
+    if (x < 0 || y < 0 || x >= root_width || y >= root_height)
+        return NULL;
+    const Cell *cell = &cells[(y / SPATIAL_CELL) * cols + x / SPATIAL_CELL];
+    Client *top = NULL;
+    for (int i = 0; i < cell->len; i++)
+    {
+        Client *c = cell->v[i];
+        if (x >= c->x && x < c->x + c->width && y >= c->y && y < c->y + c->height && visible(c) &&
+            (!top || c->stack_index > top->stack_index))
+            top = c;
+    }
+    return top;
+}
+
+/* The first visible frame overlapping the rectangle, or NULL */
+static const Client *blocker(int x, int y, int width, int height)
+{
+    int x0, y0, x1, y1;
+    cell_range(x, y, width, height, &x0, &y0, &x1, &y1);
+    for (int cy = y0; cy <= y1; cy++)
+    {
+        for (int cx = x0; cx <= x1; cx++)
+        {
+            const Cell *cell = &cells[cy * cols + cx];
+            for (int i = 0; i < cell->len; i++)
+            {
+                const Client *c = cell->v[i];
+                if (c->x < x + width && x < c->x + c->width && c->y < y + height && y < c->y + c->height &&
+                    visible(c))
+                    return c;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/* Sorts and drops duplicates; returns the new length */
+static int sort_unique(int *v, int n)
+{
+    qsort(v, n, sizeof(int), cmp_int);
+    int len = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (!len || v[len - 1] != v[i])
+            v[len++] = v[i];
+    }
+    return len;
+}
+
+int spatial_find_free(const Output *o, int width, int height, int *x, int *y)
+{
+    free_queries++;
+    if (width > o->width || height > o->height)
+        return 0;
+
+    /* Candidate corners: the output's own and the far edges of the frames
+     * on it, gathered from its cells (a frame may be listed twice) */
+    int x0, y0, x1, y1;
+    cell_range(o->x, o->y, o->width, o->height, &x0, &y0, &x1, &y1);
+    int n = 1;
+    for (int cy = y0; cy <= y1; cy++)
+    {
+        for (int cx = x0; cx <= x1; cx++)
+            n += cells[cy * cols + cx].len;
+    }
+    int *xs = malloc(2 * n * sizeof(int));
+    if (!xs)
+    {
+        log_error("Out of memory placing a window");
+        exit(EXIT_FAILURE);
+    }
+    int *ys = xs + n;
+    int nx = 0, ny = 0;
+    xs[nx++] = o->x;
+    ys[ny++] = o->y;
+    for (int cy = y0; cy <= y1; cy++)
+    {
+        for (int cx = x0; cx <= x1; cx++)
+        {
+            const Cell *cell = &cells[cy * cols + cx];
+            for (int i = 0; i < cell->len; i++)
+            {
+                const Client *c = cell->v[i];
+                if (!visible(c))
+                    continue;
+                if (c->x + c->width + width <= o->x + o->width && c->x + c->width >= o->x)
+                    xs[nx++] = c->x + c->width;
+                if (c->y + c->height + height <= o->y + o->height && c->y + c->height >= o->y)
+                    ys[ny++] = c->y + c->height;
+            }
+        }
+    }
+    nx = sort_unique(xs, nx);
+    ny = sort_unique(ys, ny);
+
+    /* Top to bottom, left to right; a blocked spot skips every candidate
+     * left of the blocking frame's right edge */
+    int found = 0;
+    for (int j = 0; j < ny && !found; j++)
+    {
+        for (int i = 0; i < nx && !found; i++)
+        {
+            candidates_tested++;
+            const Client *b = blocker(xs[i], ys[j], width, height);
+            if (!b)
+            {
+                *x = xs[i];
+                *y = ys[j];
+                found = 1;
+                break;
+            }
+            while (i + 1 < nx && xs[i + 1] < b->x + b->width)
+                i++;
+        }
+    }
+    free(xs);
+    free_found += found;
+    return found;
+}
+
+void spatial_report(FILE *out)
+{
+    int filed = 0, busiest = 0;
+    for (int i = 0; i < cols * rows; i++)
+    {
+        filed += cells[i].len;
+        if (cells[i].len > busiest)
+            busiest = cells[i].len;
+    }
+    fprintf(out, "etyWM Stats: spatial index %dx%d cells, %d entries (busiest cell %d), %lu updates (%lu refiled), "
+                 "%lu point queries, %lu placements (%lu found free, %lu spots tested)\n",
+            cols, rows, filed, busiest, updates, refiled, point_queries, free_queries, free_found,
+            candidates_tested);
+}
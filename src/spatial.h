@@ -0,0 +1,43 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include <stdio.h>
+#include "client.h"
+#include "outputs.h"
+
+/* Spatial index of frame rectangles.
+ *
+ * The root window is divided into a uniform grid of SPATIAL_CELL pixel
+ * squares, and every cell lists the frames overlapping it. Whatever changes
+ * a frame's cached geometry calls spatial_update() right away, so the
+ * index always matches the configures the WM has sent; a move that stays
+ * within the same cells costs nothing. Point and rectangle queries only
+ * look at the cells they cover and never ask the server.
+ *
+ * Only frames on the current workspace that are mapped are reported.
+ */
+
+/* Sizes the grid for the root window; call again when the screen changes.
+ * Frames already indexed are re-filed. */
+void spatial_init(int width, int height);
+
+/* The frame's geometry (c->x, c->y, c->width, c->height) changed */
+void spatial_update(Client *c);
+
+/* The client is going away */
+void spatial_remove(Client *c);
+
+/* The topmost frame containing (x, y) by the stacking order (stack.h), or
+ * NULL */
+Client *spatial_client_at(int x, int y);
+
+/* Finds a spot on 'o' for a frame of the given size that overlaps no other
+ * frame, trying the output's top-left corner and the right and bottom
+ * edges of the frames already there. Returns 0 if there is none (the frame
+ * is larger than the free space). */
+int spatial_find_free(const Output *o, int width, int height, int *x, int *y);
+
+/* Writes grid occupancy and query counters to 'out' */
+void spatial_report(FILE *out);
+
+#endif // SPATIAL_H
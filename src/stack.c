@@ -0,0 +1,251 @@
+#include "stack.h"
+#include "atoms.h"
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xproto.h>
+#include "log.h"
+
+/*
+ * 'order' is the stacking etyWM wants and 'sent' what the server has; both
+ * hold the same frames.  stack_update() keeps the longest run of frames
+ * whose relative order is already right (a longest increasing subsequence
+ * of their positions in 'sent') and restacks every other frame directly
+ * above the one that should be below it, bottom to top, which is the fewest
+ * restacks that can produce the new order.
+ */
+
+static Client **order = NULL;
+static Client **sent = NULL;
+static int *lis_tail = NULL; /* Scratch for stack_update() */
+static int *lis_prev = NULL;
+static unsigned char *keep = NULL;
+static int len = 0, cap = 0;
+static int dirty = 0;
+
+static unsigned long raises = 0;
+static unsigned long raises_unneeded = 0;
+static unsigned long layer_changes = 0;
+static unsigned long updates = 0;
+static unsigned long restacks = 0;
+static unsigned long frames_kept = 0;
+
+static void grow(void)
+{
+    int n = cap ? cap * 2 : 64;
+    Client **o = realloc(order, n * sizeof(Client *));
+    if (o)
+        order = o;
+    Client **s = realloc(sent, n * sizeof(Client *));
+    if (s)
+        sent = s;
+    int *t = realloc(lis_tail, n * sizeof(int));
+    if (t)
+        lis_tail = t;
+    int *p = realloc(lis_prev, n * sizeof(int));
+    if (p)
+        lis_prev = p;
+    unsigned char *k = realloc(keep, n);
+    if (k)
+        keep = k;
+    if (!o || !s || !t || !p || !k)
+    {
+        log_error("Out of memory growing the stacking order");
+        exit(EXIT_FAILURE);
+    }
+    cap = n;
+}
+
+static void renumber(int from)
+{
+    for (int i = from; i < len; i++)
+        order[i]->stack_index = i;
+}
+
+/* Where a frame of 'layer' goes to be on top of it, with the frame itself
+ * out of 'order' */
+static int top_of_layer(int layer)
+{
+    int i = len;
+    while (i > 0 && order[i - 1]->layer > layer)
+        i--;
+    return i;
+}
+
+static void insert(Client **v, int at, Client *c)
+{
+    memmove(&v[at + 1], &v[at], (len - at) * sizeof(Client *));
+    v[at] = c;
+}
+
+static void move_to_top(Client *c)
+{
+    int from = c->stack_index;
+    memmove(&order[from], &order[from + 1], (len - from - 1) * sizeof(Client *));
+    len--;
+    int to = top_of_layer(c->layer);
+    insert(order, to, c);
+    len++;
+    if (to == from)
+        return;
+    renumber(to < from ? to : from);
+    dirty = 1;
+}
+
+void stack_add(Client *c)
+{
+    if (len == cap)
+        grow();
+    insert(sent, len, c);
+    int to = top_of_layer(c->layer);
+    insert(order, to, c);
+    len++;
+    renumber(to);
+    if (to != len - 1)
+        dirty = 1;
+}
+
+void stack_remove(Client *c)
+{
+    int i = c->stack_index;
+    if (i >= len || order[i] != c)
+        return;
+    memmove(&order[i], &order[i + 1], (len - i - 1) * sizeof(Client *));
+    for (int j = 0; j < len; j++)
+    {
+        if (sent[j] == c)
+        {
+            memmove(&sent[j], &sent[j + 1], (len - j - 1) * sizeof(Client *));
+            break;
+        }
+    }
+    len--;
+    renumber(i);
+}
+
+void stack_raise(Client *c)
+{
+    raises++;
+    int from = c->stack_index;
+    move_to_top(c);
+    if (c->stack_index == from)
+        raises_unneeded++;
+}
+
+void stack_layer_changed(Client *c)
+{
+    int layer = c->state == STATE_FULLSCREEN ? LAYER_FULLSCREEN : c->above ? LAYER_ABOVE : LAYER_NORMAL;
+    if (layer == c->layer)
+        return;
+    layer_changes++;
+    c->layer = layer;
+    move_to_top(c);
+}
+
+int stack_client_message(const xcb_client_message_event_t *ev)
+{
+    if (ev->format != 32 || ev->type != atoms[ATOM_NET_WM_STATE])
+        return 0;
+    if (ev->data.data32[1] != atoms[ATOM_NET_WM_STATE_ABOVE] &&
+        ev->data.data32[2] != atoms[ATOM_NET_WM_STATE_ABOVE])
+        return 0;
+    Client *c = find_client(ev->window);
+    if (!c || ev->window != c->client)
+        return 1;
+
+    /* _NET_WM_STATE_REMOVE, _ADD or _TOGGLE */
+    switch (ev->data.data32[0])
+    {
+    case 0:
+        c->above = 0;
+        break;
+    case 1:
+        c->above = 1;
+        break;
+    case 2:
+        c->above = !c->above;
+        break;
+    }
+    stack_layer_changed(c);
+    return 1;
+}
+
+void stack_update(xcb_connection_t *conn)
+{
+    if (!dirty)
+        return;
+    dirty = 0;
+    updates++;
+    if (!len)
+        return;
+
+    for (int i = 0; i < len; i++)
+        sent[i]->stack_sent = i;
+
+    /* Longest run of frames, in the new order, whose old positions increase */
+    int run = 0;
+    for (int i = 0; i < len; i++)
+    {
+        int pos = order[i]->stack_sent;
+        int lo = 0, hi = run;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (order[lis_tail[mid]]->stack_sent < pos)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        lis_prev[i] = lo ? lis_tail[lo - 1] : -1;
+        lis_tail[lo] = i;
+        if (lo == run)
+            run++;
+    }
+    memset(keep, 0, len);
+    for (int i = lis_tail[run - 1]; i >= 0; i = lis_prev[i])
+        keep[i] = 1;
+    frames_kept += run;
+
+    /* The frames below the first kept one go beneath it; every other frame
+     * goes straight above the one before it, which is already in place */
+    int first_kept = 0;
+    while (!keep[first_kept])
+        first_kept++;
+    for (int i = 0; i < len; i++)
+    {
+        if (keep[i])
+            continue;
+        uint32_t values[2];
+        if (i)
+        {
+            values[0] = order[i - 1]->frame;
+            values[1] = XCB_STACK_MODE_ABOVE;
+        }
+        else
+        {
+            values[0] = order[first_kept]->frame;
+            values[1] = XCB_STACK_MODE_BELOW;
+        }
+        xcb_configure_window(conn, order[i]->frame, XCB_CONFIG_WINDOW_SIBLING | XCB_CONFIG_WINDOW_STACK_MODE,
+                             values);
+        restacks++;
+    }
+    memcpy(sent, order, len * sizeof(Client *));
+}
+
+int stack_count(void)
+{
+    return len;
+}
+
+Client *stack_at(int n)
+{
+    return n >= 0 && n < len ? order[n] : NULL;
+}
+
+void stack_report(FILE *out)
+{
+    fprintf(out, "etyWM Stats: stacking %d frames, %lu raises (%lu already on top), %lu layer changes, "
+                 "%lu updates sent %lu restacks (%lu frames left in place)\n",
+            len, raises, raises_unneeded, layer_changes, updates, restacks, frames_kept);
+}
@@ -0,0 +1,59 @@
+#ifndef STACK_H
+#define STACK_H
+
+#include <stdio.h>
+#include <xcb/xcb.h>
+#include "client.h"
+
+/* Stacking order of frames.
+ *
+ * etyWM keeps two lists of its frames, bottom to top: the order they should
+ * be in and the order the server was last told. Raises and layer changes
+ * only edit the first; stack_update() then restacks just the frames that
+ * are out of place, each directly above (or below) a neighbour, and sends
+ * nothing when the lists already agree, as for a click in a window that is
+ * already on top. Several raises in one batch cost at most one restack per
+ * frame.
+ *
+ * Frames sort into layers, and a raise only brings a frame to the top of
+ * its own. Only managed frames are tracked; other top-level windows are
+ * left where the server has them.
+ */
+
+/* Layers, bottom to top */
+enum
+{
+    LAYER_NORMAL,
+    LAYER_ABOVE,      /* _NET_WM_STATE_ABOVE */
+    LAYER_FULLSCREEN,
+    LAYERS
+};
+
+/* A frame that was just mapped or raised above every other top-level
+ * window; it is filed at the top of its layer */
+void stack_add(Client *c);
+
+/* The client is going away */
+void stack_remove(Client *c);
+
+/* Brings the frame to the top of its layer */
+void stack_raise(Client *c);
+
+/* c->state or c->above changed: moves the frame to the top of the layer it
+ * now belongs in */
+void stack_layer_changed(Client *c);
+
+/* Handles _NET_WM_STATE_ABOVE requests; returns 1 if the message was one */
+int stack_client_message(const xcb_client_message_event_t *ev);
+
+/* Sends the restacks that bring the server in line; call once per batch */
+void stack_update(xcb_connection_t *conn);
+
+/* The frames bottom to top; c->stack_index is a client's position */
+int stack_count(void);
+Client *stack_at(int n);
+
+/* Writes restack counters to 'out' */
+void stack_report(FILE *out);
+
+#endif // STACK_H
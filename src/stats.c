@@ -0,0 +1,327 @@
+#define _GNU_SOURCE /* accept4 */
+#include "stats.h"
+#include "log.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+/*
+ * Latencies are kept in HDR-style log-linear histograms: each power of two
+ * is split into HIST_SUB linear buckets, so every recorded value is known to
+ * within 1/HIST_SUB of itself whether it is 3 µs or 3 s, and recording is a
+ * couple of shifts and an increment.
+ */
+
+#define HIST_SUB_BITS 2
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS 160 /* Up to 2^41, about half an hour in ns */
+
+typedef struct
+{
+    uint64_t count[HIST_BUCKETS];
+    uint64_t samples;
+    uint64_t total;
+    uint64_t max;
+} Histogram;
+
+typedef struct
+{
+    unsigned long events;      /* Events of this type handled */
+    unsigned long round_trips; /* Blocking replies waited for while handling them */
+    unsigned long flushes;     /* xcb_flush() calls made while handling them */
+    Histogram handle_ns;       /* Time spent in the handler */
+    Histogram lag_ms;          /* Handling start relative to the server timestamp */
+} EventStats;
+
+static xcb_connection_t *stats_conn = NULL;
+static EventStats event_stats[STATS_EVENT_TYPES];
+static uint8_t current_type = 0;
+static uint64_t current_start = 0;
+
+/* Smallest (local clock - server timestamp) seen so far; the lag of an event
+ * is how much later than that it is handled. */
+static uint32_t lag_base = 0;
+static int lag_base_valid = 0;
+
+static const char *event_name(uint8_t type)
+{
+    switch (type)
+    {
+    case 0:                        return "other";
+    case XCB_KEY_PRESS:            return "KeyPress";
+    case XCB_KEY_RELEASE:          return "KeyRelease";
+    case XCB_BUTTON_PRESS:         return "ButtonPress";
+    case XCB_BUTTON_RELEASE:       return "ButtonRelease";
+    case XCB_MOTION_NOTIFY:        return "MotionNotify";
+    case XCB_ENTER_NOTIFY:         return "EnterNotify";
+    case XCB_LEAVE_NOTIFY:         return "LeaveNotify";
+    case XCB_FOCUS_IN:             return "FocusIn";
+    case XCB_FOCUS_OUT:            return "FocusOut";
+    case XCB_EXPOSE:               return "Expose";
+    case XCB_CREATE_NOTIFY:        return "CreateNotify";
+    case XCB_DESTROY_NOTIFY:       return "DestroyNotify";
+    case XCB_UNMAP_NOTIFY:         return "UnmapNotify";
+    case XCB_MAP_NOTIFY:           return "MapNotify";
+    case XCB_MAP_REQUEST:          return "MapRequest";
+    case XCB_REPARENT_NOTIFY:      return "ReparentNotify";
+    case XCB_CONFIGURE_NOTIFY:     return "ConfigureNotify";
+    case XCB_CONFIGURE_REQUEST:    return "ConfigureRequest";
+    case XCB_PROPERTY_NOTIFY:      return "PropertyNotify";
+    case XCB_CLIENT_MESSAGE:       return "ClientMessage";
+    default:                       return NULL;
+    }
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/* Server timestamp carried by the event, or XCB_CURRENT_TIME if none */
+static xcb_timestamp_t event_time(const xcb_generic_event_t *ev)
+{
+    switch (ev->response_type & ~0x80)
+    {
+    case XCB_KEY_PRESS:
+    case XCB_KEY_RELEASE:
+    case XCB_BUTTON_PRESS:
+    case XCB_BUTTON_RELEASE:
+    case XCB_MOTION_NOTIFY:
+    case XCB_ENTER_NOTIFY:
+    case XCB_LEAVE_NOTIFY:
+        /* All input events share the key event layout up to 'time' */
+        return ((const xcb_key_press_event_t *)ev)->time;
+    case XCB_PROPERTY_NOTIFY:
+        return ((const xcb_property_notify_event_t *)ev)->time;
+    default:
+        return XCB_CURRENT_TIME;
+    }
+}
+
+static int hist_index(uint64_t v)
+{
+    if (v < HIST_SUB)
+        return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    int i = (msb - HIST_SUB_BITS + 1) * HIST_SUB + (int)((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+    return i < HIST_BUCKETS ? i : HIST_BUCKETS - 1;
+}
+
+/* Smallest value that lands in bucket 'i' */
+static uint64_t hist_lower(int i)
+{
+    if (i < HIST_SUB)
+        return (uint64_t)i;
+    int shift = i / HIST_SUB - 1;
+    return (uint64_t)(HIST_SUB + i % HIST_SUB) << shift;
+}
+
+static void hist_record(Histogram *h, uint64_t v)
+{
+    h->count[hist_index(v)]++;
+    h->samples++;
+    h->total += v;
+    if (v > h->max)
+        h->max = v;
+}
+
+/* Upper bound of the bucket holding the p-th percentile */
+static uint64_t hist_percentile(const Histogram *h, double p)
+{
+    if (!h->samples)
+        return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * h->samples + 0.5);
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += h->count[i];
+        if (seen >= rank)
+        {
+            uint64_t upper = (i + 1 < HIST_BUCKETS) ? hist_lower(i + 1) - 1 : h->max;
+            return upper < h->max ? upper : h->max;
+        }
+    }
+    return h->max;
+}
+
+void stats_init(xcb_connection_t *conn)
+{
+    stats_conn = conn;
+}
+
+/* Requests issued so far: the sequence number of a NoOperation, which costs
+ * four bytes and no reply. Only called while reporting. */
+static unsigned long requests_sent(void)
+{
+    return stats_conn ? xcb_no_operation(stats_conn).sequence : 0;
+}
+
+void stats_begin_event(const xcb_generic_event_t *ev)
+{
+    uint8_t type = ev->response_type & ~0x80;
+    current_type = type < STATS_EVENT_TYPES ? type : 0;
+    event_stats[current_type].events++;
+    current_start = now_ns();
+
+    xcb_timestamp_t time = event_time(ev);
+    if (time == XCB_CURRENT_TIME)
+        return;
+    uint32_t offset = (uint32_t)(current_start / 1000000u) - time;
+    if (!lag_base_valid || (int32_t)(offset - lag_base) < 0)
+    {
+        lag_base = offset;
+        lag_base_valid = 1;
+    }
+    hist_record(&event_stats[current_type].lag_ms, offset - lag_base);
+}
+
+void stats_end_event(void)
+{
+    hist_record(&event_stats[current_type].handle_ns, now_ns() - current_start);
+    current_type = 0;
+}
+
+void stats_round_trip(void)
+{
+    event_stats[current_type].round_trips++;
+}
+
+void stats_flush(void)
+{
+    event_stats[current_type].flushes++;
+}
+
+void stats_report(FILE *out)
+{
+    fprintf(out, "etyWM Stats: %-18s %10s %12s %8s %10s %10s %10s %12s\n", "handler", "events",
+            "round_trips", "flushes", "p50_us", "p99_us", "max_us", "lag_p99_ms");
+    for (int t = 0; t < STATS_EVENT_TYPES; t++)
+    {
+        const EventStats *s = &event_stats[t];
+        if (!s->events && !s->round_trips && !s->flushes)
+            continue;
+
+        char name[32];
+        if (event_name(t))
+            snprintf(name, sizeof(name), "%s", event_name(t));
+        else
+            snprintf(name, sizeof(name), "event %d", t);
+
+        char lag[16] = "-";
+        if (s->lag_ms.samples)
+            snprintf(lag, sizeof(lag), "%llu", (unsigned long long)hist_percentile(&s->lag_ms, 99));
+
+        fprintf(out, "etyWM Stats: %-18s %10lu %12lu %8lu %10.1f %10.1f %10.1f %12s\n", name,
+                s->events, s->round_trips, s->flushes,
+                hist_percentile(&s->handle_ns, 50) / 1000.0,
+                hist_percentile(&s->handle_ns, 99) / 1000.0,
+                s->handle_ns.max / 1000.0, lag);
+    }
+    if (stats_conn)
+        fprintf(out, "etyWM Stats: %lu requests, %llu bytes sent, %llu bytes received\n",
+                requests_sent(), (unsigned long long)xcb_total_written(stats_conn),
+                (unsigned long long)xcb_total_read(stats_conn));
+}
+
+static void hist_json(FILE *out, const char *key, const Histogram *h)
+{
+    fprintf(out, "\"%s\":{\"samples\":%llu,\"total\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,"
+                 "\"max\":%llu,\"buckets\":[",
+            key, (unsigned long long)h->samples, (unsigned long long)h->total,
+            (unsigned long long)hist_percentile(h, 50), (unsigned long long)hist_percentile(h, 90),
+            (unsigned long long)hist_percentile(h, 99), (unsigned long long)h->max);
+    int first = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        if (!h->count[i])
+            continue;
+        fprintf(out, "%s[%llu,%llu]", first ? "" : ",", (unsigned long long)hist_lower(i),
+                (unsigned long long)h->count[i]);
+        first = 0;
+    }
+    fprintf(out, "]}");
+}
+
+void stats_report_json(FILE *out)
+{
+    fprintf(out, "{\"events\":{");
+    int first = 1;
+    for (int t = 0; t < STATS_EVENT_TYPES; t++)
+    {
+        const EventStats *s = &event_stats[t];
+        if (!s->events && !s->round_trips && !s->flushes)
+            continue;
+
+        if (event_name(t))
+            fprintf(out, "%s\"%s\":{", first ? "" : ",", event_name(t));
+        else
+            fprintf(out, "%s\"event_%d\":{", first ? "" : ",", t);
+        fprintf(out, "\"count\":%lu,\"round_trips\":%lu,\"flushes\":%lu,", s->events,
+                s->round_trips, s->flushes);
+        hist_json(out, "handle_ns", &s->handle_ns);
+        fprintf(out, ",");
+        hist_json(out, "lag_ms", &s->lag_ms);
+        fprintf(out, "}");
+        first = 0;
+    }
+    fprintf(out, "},\"requests\":%lu,\"bytes_sent\":%llu,\"bytes_received\":%llu,"
+                 "\"log_dropped\":%lu}\n",
+            requests_sent(),
+            (unsigned long long)(stats_conn ? xcb_total_written(stats_conn) : 0),
+            (unsigned long long)(stats_conn ? xcb_total_read(stats_conn) : 0), log_dropped_count());
+}
+
+int stats_listen(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        log_warn("Stats socket path too long: %s", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        log_warn("Could not create stats socket: %s", strerror(errno));
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0)
+    {
+        log_warn("Could not listen on stats socket %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    log_info("Serving stats on %s", path);
+    return fd;
+}
+
+void stats_serve(int listen_fd)
+{
+    int fd;
+    /* Readers get a non-blocking socket: a reader that stops reading gets a
+     * truncated report rather than stalling the event loop. */
+    while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        FILE *out = fdopen(fd, "w");
+        if (!out)
+        {
+            close(fd);
+            continue;
+        }
+        stats_report_json(out);
+        fclose(out);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <xcb/xcb.h>
+
+/* Core event codes are below 64; extension events live above that. */
+#define STATS_EVENT_TYPES 128
+
+/* Remembers the connection whose request and byte totals get reported */
+void stats_init(xcb_connection_t *conn);
+
+/* Marks the start and end of handling one event. Handling time, round trips
+ * and flushes in between are attributed to the event's type; anything
+ * outside a handler (startup, the event loop's flush) is attributed to
+ * type 0. For events carrying a
+ * server timestamp, how far handling lags behind it is recorded as well.
+ */
+void stats_begin_event(const xcb_generic_event_t *ev);
+void stats_end_event(void);
+
+/* Call immediately before every blocking *_reply() wait */
+void stats_round_trip(void);
+
+/* Call immediately before every xcb_flush() */
+void stats_flush(void);
+
+/* Writes per-handler counters and latency percentiles to 'out' */
+void stats_report(FILE *out);
+
+/* Writes the same data, including raw histogram buckets, as one JSON object */
+void stats_report_json(FILE *out);
+
+/* Listens for stats readers on a Unix socket at 'path'; returns the listening
+ * descriptor or -1. Every connection gets one JSON report and is closed.
+ */
+int stats_listen(const char *path);
+void stats_serve(int listen_fd);
+
+#endif // STATS_H
@@ -0,0 +1,372 @@
+#include "title.h"
+#include "atoms.h"
+#include "config.h"
+#include "stats.h"
+#include <cairo/cairo.h>
+#include <cairo/cairo-xcb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+#include "log.h"
+
+#define TITLE_FETCH  (1 << 0) /* Name property must be re-read */
+#define TITLE_REDRAW (1 << 1) /* Width may have changed */
+
+/* The name is read up to this many bytes */
+#define TITLE_MAX_BYTES 256
+
+/*
+ * Shaped text, keyed by the string.  The cache is direct-mapped on a hash of
+ * the text; a colliding string simply replaces the old entry.  Glyph
+ * positions are relative to the start of the baseline.
+ */
+#define LAYOUT_CACHE_SIZE 256 /* Power of two */
+
+typedef struct
+{
+    uint32_t hash;
+    char *text;
+    cairo_glyph_t *glyphs;
+    int nglyphs;
+    double width;
+} TextLayout;
+
+static TextLayout layouts[LAYOUT_CACHE_SIZE];
+static unsigned long layout_hits = 0;
+static unsigned long layout_misses = 0;
+
+static xcb_connection_t *title_conn = NULL;
+static xcb_visualtype_t *title_visual = NULL;
+static cairo_scaled_font_t *title_font = NULL;
+static double title_baseline = 0;
+
+static Client **pending = NULL;
+static int pending_len = 0;
+static int pending_cap = 0;
+
+static uint32_t hash_text(const char *s)
+{
+    uint32_t h = 2166136261u; /* FNV-1a */
+    for (; *s; s++)
+        h = (h ^ (uint8_t)*s) * 16777619u;
+    return h;
+}
+
+static const TextLayout *layout_get(const char *text)
+{
+    uint32_t hash = hash_text(text);
+    TextLayout *l = &layouts[hash & (LAYOUT_CACHE_SIZE - 1)];
+    if (l->text && l->hash == hash && strcmp(l->text, text) == 0)
+    {
+        layout_hits++;
+        return l;
+    }
+    layout_misses++;
+
+    free(l->text);
+    cairo_glyph_free(l->glyphs);
+    memset(l, 0, sizeof(*l));
+    l->hash = hash;
+    l->text = strdup(text);
+    if (!l->text)
+    {
+        log_error("Out of memory caching title text");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Invalid UTF-8 leaves the layout empty rather than failing the draw */
+    if (cairo_scaled_font_text_to_glyphs(title_font, 0, 0, text, -1, &l->glyphs, &l->nglyphs,
+                                         NULL, NULL, NULL) != CAIRO_STATUS_SUCCESS)
+    {
+        l->glyphs = NULL;
+        l->nglyphs = 0;
+    }
+    if (l->nglyphs)
+    {
+        cairo_text_extents_t ext;
+        cairo_scaled_font_glyph_extents(title_font, l->glyphs, l->nglyphs, &ext);
+        l->width = ext.x_advance;
+    }
+    return l;
+}
+
+void title_cache_report(FILE *out)
+{
+    fprintf(out, "etyWM Stats: title layouts %lu hits, %lu misses (%d slots)\n",
+            layout_hits, layout_misses, LAYOUT_CACHE_SIZE);
+}
+
+void title_init(xcb_connection_t *conn, xcb_screen_t *screen)
+{
+    title_conn = conn;
+
+    for (xcb_depth_iterator_t d = xcb_screen_allowed_depths_iterator(screen); d.rem && !title_visual;
+         xcb_depth_next(&d))
+    {
+        for (xcb_visualtype_iterator_t v = xcb_depth_visuals_iterator(d.data); v.rem; xcb_visualtype_next(&v))
+        {
+            if (v.data->visual_id == screen->root_visual)
+            {
+                title_visual = v.data;
+                break;
+            }
+        }
+    }
+
+    cairo_font_face_t *face = cairo_toy_font_face_create(TITLE_FONT, CAIRO_FONT_SLANT_NORMAL,
+                                                         CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_matrix_t size, ctm;
+    cairo_matrix_init_scale(&size, TITLE_FONT_SIZE, TITLE_FONT_SIZE);
+    cairo_matrix_init_identity(&ctm);
+    cairo_font_options_t *options = cairo_font_options_create();
+    title_font = cairo_scaled_font_create(face, &size, &ctm, options);
+    cairo_font_options_destroy(options);
+    cairo_font_face_destroy(face);
+
+    /* Centre the font's ascent+descent box in the bar */
+    cairo_font_extents_t fe;
+    cairo_scaled_font_extents(title_font, &fe);
+    title_baseline = (TITLE_BAR_HEIGHT - (fe.ascent + fe.descent)) / 2 + fe.ascent;
+}
+
+static void set_source_color(cairo_t *cr, uint32_t rgb)
+{
+    cairo_set_source_rgb(cr, ((rgb >> 16) & 0xFF) / 255.0, ((rgb >> 8) & 0xFF) / 255.0,
+                         (rgb & 0xFF) / 255.0);
+}
+
+static void title_draw(Client *c, int x, int y, int width, int height)
+{
+    if (!title_visual || !title_font)
+        return;
+
+    int bar_width = c->width - 2 * RESIZE_BORDER;
+    if (!c->title_surface)
+        c->title_surface = cairo_xcb_surface_create(title_conn, c->title, title_visual,
+                                                    bar_width, TITLE_BAR_HEIGHT);
+    else if (bar_width != c->title_drawn_width)
+        cairo_xcb_surface_set_size(c->title_surface, bar_width, TITLE_BAR_HEIGHT);
+    c->title_drawn_width = bar_width;
+
+    cairo_t *cr = cairo_create(c->title_surface);
+    cairo_rectangle(cr, x, y, width, height);
+    cairo_clip(cr);
+    set_source_color(cr, TITLE_BG_COLOR);
+    cairo_paint(cr);
+
+    if (c->title_text && *c->title_text)
+    {
+        const TextLayout *text = layout_get(c->title_text);
+        double avail = bar_width - 2 * TITLE_PADDING;
+        int n = text->nglyphs;
+        const TextLayout *ellipsis = NULL;
+
+        /* Too long: keep the glyphs that fit in front of an ellipsis */
+        if (text->width > avail)
+        {
+            ellipsis = layout_get("\xE2\x80\xA6");
+            double limit = avail - ellipsis->width;
+            n = 0;
+            while (n < text->nglyphs && (n + 1 < text->nglyphs ? text->glyphs[n + 1].x : text->width) <= limit)
+                n++;
+        }
+
+        set_source_color(cr, TITLE_FG_COLOR);
+        cairo_set_scaled_font(cr, title_font);
+        cairo_translate(cr, TITLE_PADDING, title_baseline);
+        cairo_show_glyphs(cr, text->glyphs, n);
+        if (ellipsis)
+        {
+            cairo_translate(cr, n < text->nglyphs ? text->glyphs[n].x : text->width, 0);
+            cairo_show_glyphs(cr, ellipsis->glyphs, ellipsis->nglyphs);
+        }
+    }
+
+    cairo_destroy(cr);
+    cairo_surface_flush(c->title_surface);
+}
+
+void title_expose(Client *c, int x, int y, int width, int height)
+{
+    title_draw(c, x, y, width, height);
+}
+
+static void queue(Client *c, int work)
+{
+    if (!c->title_dirty)
+    {
+        if (pending_len == pending_cap)
+        {
+            int cap = pending_cap ? pending_cap * 2 : 16;
+            Client **grown = realloc(pending, cap * sizeof(Client *));
+            if (!grown)
+            {
+                log_error("Out of memory queueing title update");
+                exit(EXIT_FAILURE);
+            }
+            pending = grown;
+            pending_cap = cap;
+        }
+        pending[pending_len++] = c;
+    }
+    c->title_dirty |= work;
+}
+
+void title_property_notify(Client *c, xcb_atom_t atom)
+{
+    if (atom == atoms[ATOM_NET_WM_NAME] || atom == XCB_ATOM_WM_NAME)
+        queue(c, TITLE_FETCH);
+}
+
+void title_fetch(Client *c)
+{
+    queue(c, TITLE_FETCH);
+}
+
+void title_invalidate(Client *c)
+{
+    queue(c, TITLE_REDRAW);
+}
+
+/* WM_NAME of type STRING is Latin-1; cairo wants UTF-8 */
+static char *latin1_to_utf8(const uint8_t *s, int len)
+{
+    char *out = malloc(2 * len + 1), *p = out;
+    if (!out)
+        return NULL;
+    for (int i = 0; i < len; i++)
+    {
+        if (s[i] < 0x80)
+        {
+            *p++ = s[i];
+        }
+        else
+        {
+            *p++ = 0xC0 | (s[i] >> 6);
+            *p++ = 0x80 | (s[i] & 0x3F);
+        }
+    }
+    *p = '\0';
+    return out;
+}
+
+/* Names longer than TITLE_MAX_BYTES are cut off, possibly inside a
+ * character; returns 'len' less such a trailing partial UTF-8 sequence,
+ * which would make cairo reject the whole string */
+static int utf8_complete_length(const uint8_t *s, int len)
+{
+    int start = len - 1;
+    while (start > 0 && len - start < 4 && (s[start] & 0xC0) == 0x80)
+        start--;
+    if (start < 0)
+        return len;
+    uint8_t lead = s[start];
+    int need = (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 : (lead & 0xF8) == 0xF0 ? 4 : 1;
+    return len - start < need ? start : len;
+}
+
+/* Takes the name from the replies, preferring _NET_WM_NAME; NULL if none */
+static char *read_name(xcb_get_property_reply_t *net_name, xcb_get_property_reply_t *wm_name)
+{
+    if (net_name && xcb_get_property_value_length(net_name) > 0)
+    {
+        const uint8_t *s = xcb_get_property_value(net_name);
+        return strndup((const char *)s, utf8_complete_length(s, xcb_get_property_value_length(net_name)));
+    }
+    if (wm_name && xcb_get_property_value_length(wm_name) > 0)
+    {
+        const uint8_t *s = xcb_get_property_value(wm_name);
+        int len = xcb_get_property_value_length(wm_name);
+        if (wm_name->type == XCB_ATOM_STRING)
+            return latin1_to_utf8(s, len);
+        return strndup((const char *)s, utf8_complete_length(s, len));
+    }
+    return NULL;
+}
+
+void titles_update(xcb_connection_t *conn)
+{
+    if (!pending_len)
+        return;
+
+    /* Send every name request first so they share one round trip */
+    xcb_get_property_cookie_t *cookies = malloc(2 * pending_len * sizeof(*cookies));
+    if (!cookies)
+    {
+        log_error("Out of memory reading titles");
+        exit(EXIT_FAILURE);
+    }
+    int fetching = 0;
+    for (int i = 0; i < pending_len; i++)
+    {
+        Client *c = pending[i];
+        if (!(c->title_dirty & TITLE_FETCH))
+            continue;
+        cookies[2 * i] = xcb_get_property(conn, 0, c->client, atoms[ATOM_NET_WM_NAME],
+                                          atoms[ATOM_UTF8_STRING], 0, TITLE_MAX_BYTES / 4);
+        cookies[2 * i + 1] = xcb_get_property(conn, 0, c->client, XCB_ATOM_WM_NAME,
+                                              XCB_GET_PROPERTY_TYPE_ANY, 0, TITLE_MAX_BYTES / 4);
+        fetching = 1;
+    }
+    if (fetching)
+        stats_round_trip();
+
+    for (int i = 0; i < pending_len; i++)
+    {
+        Client *c = pending[i];
+        int redraw = (c->title_dirty & TITLE_REDRAW) &&
+                     c->width - 2 * RESIZE_BORDER != c->title_drawn_width;
+
+        if (c->title_dirty & TITLE_FETCH)
+        {
+            xcb_get_property_reply_t *net_name = xcb_get_property_reply(conn, cookies[2 * i], NULL);
+            xcb_get_property_reply_t *wm_name = xcb_get_property_reply(conn, cookies[2 * i + 1], NULL);
+            char *name = read_name(net_name, wm_name);
+            free(net_name);
+            free(wm_name);
+
+            /* Terminals often re-announce the title they already have */
+            if (!name || !c->title_text || strcmp(name, c->title_text) != 0)
+            {
+                free(c->title_text);
+                c->title_text = name;
+                redraw = 1;
+            }
+            else
+            {
+                free(name);
+            }
+        }
+
+        c->title_dirty = 0;
+        if (redraw)
+            title_draw(c, 0, 0, c->width, TITLE_BAR_HEIGHT);
+    }
+
+    free(cookies);
+    pending_len = 0;
+}
+
+void title_forget(Client *c)
+{
+    if (c->title_dirty)
+    {
+        for (int i = 0; i < pending_len; i++)
+        {
+            if (pending[i] == c)
+            {
+                pending[i] = pending[--pending_len];
+                break;
+            }
+        }
+        c->title_dirty = 0;
+    }
+    if (c->title_surface)
+    {
+        cairo_surface_destroy(c->title_surface);
+        c->title_surface = NULL;
+    }
+    free(c->title_text);
+    c->title_text = NULL;
+}
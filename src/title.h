@@ -0,0 +1,40 @@
+#ifndef TITLE_H
+#define TITLE_H
+
+#include <stdio.h>
+#include <xcb/xcb.h>
+#include "client.h"
+
+/* Title bar text.
+ *
+ * Each title bar keeps one cairo-xcb surface for its whole life. Text is
+ * shaped once per distinct string into a glyph run kept in a cache shared by
+ * all titles, so redraws (Expose, resizes, a terminal re-announcing the same
+ * title) only fill the bar and show cached glyphs.
+ */
+
+/* Sets up the font; call once after atoms_init() */
+void title_init(xcb_connection_t *conn, xcb_screen_t *screen);
+
+/* Queue work for titles_update(): re-read the client's name after a
+ * PropertyNotify for _NET_WM_NAME/WM_NAME (other atoms are ignored), or
+ * just redraw, e.g. after the title bar changed width */
+void title_property_notify(Client *c, xcb_atom_t atom);
+void title_fetch(Client *c);
+void title_invalidate(Client *c);
+
+/* Redraws the given part of the title bar now (Expose) */
+void title_expose(Client *c, int x, int y, int width, int height);
+
+/* Does the queued work: all name reads share one round trip, and a title
+ * is only redrawn if its text or width actually changed. Call once per
+ * event batch. */
+void titles_update(xcb_connection_t *conn);
+
+/* Releases the client's surface and text; call before it is removed */
+void title_forget(Client *c);
+
+/* Writes layout cache counters to 'out' */
+void title_cache_report(FILE *out);
+
+#endif // TITLE_H
@@ -0,0 +1,152 @@
+#include "workspace.h"
+#include "atoms.h"
+#include "config.h"
+#include "layout.h"
+#include <stdint.h>
+#include <time.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+#include "log.h"
+
+/*
+ * Workspace switching.
+ *
+ * Hiding a workspace is one UnmapWindow per frame, showing one MapWindow.
+ * Frames keep their place in the stacking order while unmapped, so a shown
+ * workspace comes back exactly as it was left.  The new workspace is mapped
+ * before the old one is unmapped, so nothing underneath (the wallpaper) is
+ * exposed in between.  Tiles of hidden workspaces stay in layout.c, and
+ * title.c keeps drawing into unmapped title bars, so nothing has to be
+ * recomputed on the way back.
+ *
+ * The switch time counted here is only how long queueing the requests
+ * takes; what the user sees also includes the server mapping the frames
+ * and the compositor repainting, which bench_wm's workspace phase measures.
+ */
+
+static xcb_window_t root = XCB_NONE;
+static int current = 0;
+
+static unsigned long switches = 0;
+static unsigned long frames_mapped = 0;
+static unsigned long frames_unmapped = 0;
+static uint64_t switch_ns_last = 0;
+static uint64_t switch_ns_max = 0;
+static uint64_t switch_ns_total = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void set_cardinal(xcb_connection_t *conn, xcb_window_t win, int atom, uint32_t value)
+{
+    if (atoms[atom] == XCB_ATOM_NONE)
+        return;
+    xcb_change_property(conn, XCB_PROP_MODE_REPLACE, win, atoms[atom], XCB_ATOM_CARDINAL, 32, 1, &value);
+}
+
+void workspace_init(xcb_connection_t *conn, xcb_screen_t *screen)
+{
+    root = screen->root;
+    set_cardinal(conn, root, ATOM_NET_NUMBER_OF_DESKTOPS, WORKSPACES);
+    set_cardinal(conn, root, ATOM_NET_CURRENT_DESKTOP, current);
+}
+
+int workspace_current(void)
+{
+    return current;
+}
+
+void workspace_add_client(xcb_connection_t *conn, Client *c)
+{
+    c->workspace = current;
+    set_cardinal(conn, c->client, ATOM_NET_WM_DESKTOP, current);
+}
+
+void workspace_switch(xcb_connection_t *conn, int n)
+{
+    if (n < 0 || n >= WORKSPACES || n == current)
+        return;
+
+    uint64_t start = now_ns();
+    int count = client_count();
+    for (int i = 0; i < count; i++)
+    {
+        Client *c = client_at(i);
+        if (c->workspace == n && !c->withdrawn)
+        {
+            xcb_map_window(conn, c->frame);
+            frames_mapped++;
+        }
+    }
+    for (int i = 0; i < count; i++)
+    {
+        Client *c = client_at(i);
+        if (c->workspace == current && !c->withdrawn)
+        {
+            xcb_unmap_window(conn, c->frame);
+            frames_unmapped++;
+        }
+    }
+    log_debug("Switched from workspace %d to %d", current, n);
+    current = n;
+    set_cardinal(conn, root, ATOM_NET_CURRENT_DESKTOP, current);
+
+    uint64_t ns = now_ns() - start;
+    switches++;
+    switch_ns_last = ns;
+    switch_ns_total += ns;
+    if (ns > switch_ns_max)
+        switch_ns_max = ns;
+}
+
+void workspace_move_client(xcb_connection_t *conn, Client *c, int n)
+{
+    if (n < 0 || n >= WORKSPACES || n == c->workspace)
+        return;
+
+    if (!c->withdrawn)
+    {
+        if (c->workspace == current)
+            xcb_unmap_window(conn, c->frame);
+        else if (n == current)
+            xcb_map_window(conn, c->frame);
+    }
+    /* Its tile moves to the other workspace's layout */
+    layout_remove(c);
+    c->workspace = n;
+    set_cardinal(conn, c->client, ATOM_NET_WM_DESKTOP, n);
+    if (!c->withdrawn)
+        layout_insert(c);
+    log_debug("Moved client 0x%x to workspace %d", c->client, n);
+}
+
+int workspace_client_message(xcb_connection_t *conn, const xcb_client_message_event_t *ev)
+{
+    if (ev->format != 32)
+        return 0;
+    if (ev->type == atoms[ATOM_NET_CURRENT_DESKTOP] && ev->window == root)
+    {
+        workspace_switch(conn, (int)ev->data.data32[0]);
+        return 1;
+    }
+    if (ev->type == atoms[ATOM_NET_WM_DESKTOP])
+    {
+        Client *c = find_client(ev->window);
+        if (c && ev->window == c->client)
+            workspace_move_client(conn, c, (int)ev->data.data32[0]);
+        return 1;
+    }
+    return 0;
+}
+
+void workspace_report(FILE *out)
+{
+    fprintf(out, "etyWM Stats: workspace %d of %d, %lu switches (%lu frames mapped, %lu unmapped), "
+                 "requests queued in last %.1f us, avg %.1f us, max %.1f us\n",
+            current + 1, WORKSPACES, switches, frames_mapped, frames_unmapped, switch_ns_last / 1e3,
+            switches ? (double)switch_ns_total / switches / 1e3 : 0.0, switch_ns_max / 1e3);
+}
@@ -0,0 +1,43 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <stdio.h>
+#include <xcb/xcb.h>
+#include "client.h"
+
+/* Virtual workspaces (WORKSPACES in config.h).
+ *
+ * Every client belongs to one workspace. Switching unmaps the frames of the
+ * workspace being left and maps those of the one being entered, in one batch
+ * and nothing else: client windows stay mapped inside their frames, so they
+ * see no UnmapNotify, and shape masks, title bars and tiles are left exactly
+ * as they were. The frames' own UnmapNotify events are not about the client
+ * and are ignored like any other frame unmap.
+ *
+ * The current workspace and each client's are published through EWMH
+ * (_NET_NUMBER_OF_DESKTOPS, _NET_CURRENT_DESKTOP, _NET_WM_DESKTOP), and
+ * pagers or wmctrl switch through the matching client messages.
+ */
+
+/* Publishes the workspace count and the current workspace on the root */
+void workspace_init(xcb_connection_t *conn, xcb_screen_t *screen);
+
+int workspace_current(void);
+
+/* Puts a newly managed client on the current workspace */
+void workspace_add_client(xcb_connection_t *conn, Client *c);
+
+/* Shows workspace 'n' and hides the current one */
+void workspace_switch(xcb_connection_t *conn, int n);
+
+/* Moves a client to workspace 'n', hiding or showing its frame */
+void workspace_move_client(xcb_connection_t *conn, Client *c, int n);
+
+/* Handles _NET_CURRENT_DESKTOP and _NET_WM_DESKTOP requests. Returns 1 if
+ * 'ev' was one of them. */
+int workspace_client_message(xcb_connection_t *conn, const xcb_client_message_event_t *ev);
+
+/* Writes switch counters and timings to 'out' */
+void workspace_report(FILE *out);
+
+#endif // WORKSPACE_H
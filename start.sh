@@ -5,7 +5,7 @@ SRC_DIR="./src"
 
 # Compile the window manager from source files in $SRC_DIR
 echo "Compiling window manager..."
-gcc -Wall -O2 "$SRC_DIR"/main.c "$SRC_DIR"/client.c "$SRC_DIR"/draw.c -o etyWM $(pkg-config --cflags --libs xcb-shape xcb cairo) -lxcb -lxcb-render -lxcb-composite -lm
+gcc -Wall -O2 "$SRC_DIR"/main.c "$SRC_DIR"/client.c "$SRC_DIR"/registry.c "$SRC_DIR"/events.c "$SRC_DIR"/stats.c "$SRC_DIR"/atoms.c "$SRC_DIR"/resize_sync.c "$SRC_DIR"/image.c "$SRC_DIR"/draw.c "$SRC_DIR"/log.c "$SRC_DIR"/outputs.c "$SRC_DIR"/title.c "$SRC_DIR"/compositor.c "$SRC_DIR"/resources.c "$SRC_DIR"/layout.c "$SRC_DIR"/workspace.c "$SRC_DIR"/loop.c "$SRC_DIR"/control.c "$SRC_DIR"/launcher.c "$SRC_DIR"/spatial.c "$SRC_DIR"/stack.c -o etyWM $(pkg-config --cflags --libs xcb-shape xcb-sync xcb-shm xcb-randr xcb-composite xcb-damage xcb-xfixes xcb-render xcb cairo) -lxcb -lxcb-render -lxcb-composite -lm -pthread
 
 if [ $? -ne 0 ]; then
     echo "Compilation failed!"